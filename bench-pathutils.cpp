@@ -0,0 +1,742 @@
+
+// Benchmarks for the hot pathutils entry points, using Google Benchmark.
+//
+// Every benchmark is run against a set of reproducible corpora (see `corpus_id` below) and reports:
+//
+// - time/path        : the average time spent per path (reported in seconds, with SI prefix, e.g. `42.1n` = 42.1 ns/path)
+// - bytes_per_second : the input throughput (Google Benchmark's own SetBytesProcessed() based counter)
+// - allocs/path      : the average number of heap allocations per path, when the platform allows us to count them
+//
+// The corpora are generated from a fixed seed, using our own tiny PRNG-to-choice mapping instead of
+// the std::uniform_*_distribution classes, as those produce different sequences in MSVC, libstdc++ and libc++:
+// we want the *same* paths on every platform, so numbers can be compared across builds and machines.
+//
+// Build it as the `pathutils_bench` target of the Makefile, which links it against the libpathutils and mupdf archives
+// of the parent project and against Google Benchmark (-lbenchmark).
+
+#include "mupdf/fitz.h"
+#include "mupdf/helpers/dir.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "pathutils.h"
+#include "pathutils.hpp"
+#include "internal-utils.h"
+#include "sanitation-driver.h"
+
+#include "benchmark/benchmark.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <variant>
+
+
+// --- allocation counting ---------------------------------------------------------------------------
+//
+// We count at the malloc() level, so C++ `new`, mupdf's default fz_malloc() and curl's malloc() calls are all accounted for.
+// This is only done in standalone builds: a monolithic build MUST NOT have its heap hijacked by a benchmark module.
+
+static std::atomic<uint64_t> bench_alloc_count{0};
+
+#if !defined(BUILD_MONOLITHIC) && defined(__GLIBC__)
+
+#define PATHUTILS_BENCH_COUNTS_ALLOCATIONS    1
+
+extern "C" {
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t n, size_t size);
+	void *__libc_realloc(void *ptr, size_t size);
+
+	void *malloc(size_t size) {
+		bench_alloc_count.fetch_add(1, std::memory_order_relaxed);
+		return __libc_malloc(size);
+	}
+
+	void *calloc(size_t n, size_t size) {
+		bench_alloc_count.fetch_add(1, std::memory_order_relaxed);
+		return __libc_calloc(n, size);
+	}
+
+	void *realloc(void *ptr, size_t size) {
+		bench_alloc_count.fetch_add(1, std::memory_order_relaxed);
+		return __libc_realloc(ptr, size);
+	}
+}
+
+#elif !defined(BUILD_MONOLITHIC) && defined(_MSC_VER) && defined(_DEBUG)
+
+#include <crtdbg.h>
+
+#define PATHUTILS_BENCH_COUNTS_ALLOCATIONS    1
+
+static int bench_alloc_hook(int alloc_type, void *user_data, size_t size, int block_type, long request_number, const unsigned char *filename, int line_number)
+{
+	if (alloc_type != _HOOK_FREE)
+		bench_alloc_count.fetch_add(1, std::memory_order_relaxed);
+	return TRUE;
+}
+
+#else
+
+#define PATHUTILS_BENCH_COUNTS_ALLOCATIONS    0
+
+#endif
+
+
+// --- corpora ---------------------------------------------------------------------------------------
+
+enum corpus_id {
+	CORPUS_SHORT_NAMES,           // `readme.txt`, `IMG_0042.JPG`, ...
+	CORPUS_DEEP_TREES,            // relative and absolute paths, 8..40 directories deep
+	CORPUS_UNC,                   // `\\server\share\...` and `//server/share/...`
+	CORPUS_LONG_PATH_PREFIX,      // `//?/C:/...` and `\\?\C:\...`
+	CORPUS_HEAVY_UTF8,            // CJK, Cyrillic, Greek, emoji and supplementary plane codepoints
+	CORPUS_ADVERSARIAL_DOTDOT,    // long `../`, `./` and `////` chains, a.k.a. the 'quadratic killers'
+	CORPUS_STDIO_CHANNELS,        // `/dev/stdout`, `CON:`, `-`, `lpt3`, ... mixed with regular paths
+	CORPUS_COUNT
+};
+
+static const char *corpus_names[CORPUS_COUNT] = {
+	"short_names",
+	"deep_trees",
+	"unc",
+	"long_path_prefix",
+	"heavy_utf8",
+	"adversarial_dotdot",
+	"stdio_channels",
+};
+
+// the number of paths in each corpus; the benchmarks cycle through them.
+static const size_t corpus_size = 4096;
+static const uint64_t corpus_seed = 0x5A17A71E5EEDULL;
+
+class corpus_generator {
+public:
+	explicit corpus_generator(uint64_t seed) :
+		rng_(seed)
+	{}
+
+	// pick a number in the range [0, n): the slight modulo bias doesn't bother us, being reproducible does.
+	size_t pick(size_t n) {
+		return (size_t)(rng_() % n);
+	}
+
+	template <size_t N>
+	const char *pick_from(const char *const (&set)[N]) {
+		return set[pick(N)];
+	}
+
+	std::string name(size_t min_len, size_t max_len) {
+		static const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-. ()";
+		size_t len = min_len + pick(max_len - min_len + 1);
+		std::string s;
+		s.reserve(len);
+		for (size_t i = 0; i < len; i++)
+			s += charset[pick(sizeof(charset) - 1)];
+		return s;
+	}
+
+	std::string utf8_name(size_t min_len, size_t max_len) {
+		static const char *const glyphs[] = {
+			"\xE4\xB8\xAD", "\xE6\x96\x87", "\xE5\xAD\x97", "\xE6\xAA\x94", "\xE6\xA1\x88",        // 中文字檔案
+			"\xE3\x83\x95", "\xE3\x82\xA1", "\xE3\x82\xA4", "\xE3\x83\xAB",                        // ファイル
+			"\xED\x8C\x8C", "\xEC\x9D\xBC",                                                        // 파일
+			"\xD1\x84", "\xD0\xB0", "\xD0\xB9", "\xD0\xBB", "\xD0\xB8\xD0\xBA",                    // файлик
+			"\xCE\xB1", "\xCE\xB2", "\xCE\xB3",                                                    // αβγ
+			"\xF0\x9F\x93\x81", "\xF0\x9F\x98\x80",                                                // emoji
+			"\xF0\xA0\x80\x80", "\xF0\xA0\x9C\x8E",                                                // CJK Extension B
+			"a", "b", "x", "1", "_", ".", " ",
+		};
+		size_t len = min_len + pick(max_len - min_len + 1);
+		std::string s;
+		for (size_t i = 0; i < len; i++)
+			s += pick_from(glyphs);
+		return s;
+	}
+
+	std::string dirchain(size_t min_depth, size_t max_depth, char sep) {
+		size_t depth = min_depth + pick(max_depth - min_depth + 1);
+		std::string s;
+		for (size_t i = 0; i < depth; i++) {
+			s += name(1, 16);
+			s += sep;
+		}
+		return s;
+	}
+
+	std::string path_for(corpus_id id) {
+		static const char *const extensions[] = {
+			".txt", ".html", ".jpg", ".JPG", ".pdf", ".tar.gz", "", ".c++", ".",
+		};
+
+		switch (id) {
+		default:
+		case CORPUS_SHORT_NAMES:
+			return name(1, 12) + pick_from(extensions);
+
+		case CORPUS_DEEP_TREES:
+			return (pick(2) ? "/" : "") + dirchain(8, 40, '/') + name(1, 24) + pick_from(extensions);
+
+		case CORPUS_UNC: {
+			char sep = (pick(2) ? '\\' : '/');
+			std::string s(2, sep);
+			s += name(3, 12);
+			s += sep;
+			s += name(1, 8);
+			s += "$";
+			s += sep;
+			return s + dirchain(1, 8, sep) + name(1, 24) + pick_from(extensions);
+		}
+
+		case CORPUS_LONG_PATH_PREFIX: {
+			char sep = (pick(2) ? '\\' : '/');
+			std::string s(2, sep);
+			s += (pick(2) ? '?' : '.');
+			s += sep;
+			s += (char)('A' + pick(26));
+			s += ':';
+			s += sep;
+			return s + dirchain(1, 12, sep) + name(1, 24) + pick_from(extensions);
+		}
+
+		case CORPUS_HEAVY_UTF8: {
+			std::string s;
+			size_t depth = 1 + pick(6);
+			for (size_t i = 0; i < depth; i++) {
+				s += utf8_name(1, 12);
+				s += '/';
+			}
+			return s + utf8_name(1, 20) + pick_from(extensions);
+		}
+
+		case CORPUS_ADVERSARIAL_DOTDOT: {
+			static const char *const hostile[] = {
+				"../", "./", "//", "////", "/./", "/../", "a/../", "..", ".../", "\\..\\", "x/./y/../",
+			};
+			std::string s = (pick(2) ? "" : "a/b/c/");
+			size_t count = 16 + pick(240);
+			for (size_t i = 0; i < count; i++) {
+				if (pick(4) == 0) {
+					s += name(1, 4);
+					s += '/';
+				}
+				else {
+					s += pick_from(hostile);
+				}
+			}
+			return s + name(1, 8);
+		}
+
+		case CORPUS_STDIO_CHANNELS: {
+			static const char *const channels[] = {
+				"-", "+", "1", "2", "/dev/stdout", "/dev/stderr", "/dev/null", "stdout", "stderr",
+				"con", "CON:", "nul", "NUL:", "aux", "prn:", "com1", "COM9:", "lpt3", "LPT1:", "com0",
+			};
+			if (pick(3) == 0)
+				return name(1, 12) + pick_from(extensions);
+			return pick_from(channels);
+		}
+		}
+	}
+
+private:
+	std::mt19937_64 rng_;
+};
+
+struct corpus {
+	std::vector<std::string> paths;
+	size_t max_path_length{0};
+};
+
+static const corpus &get_corpus(corpus_id id)
+{
+	static corpus corpora[CORPUS_COUNT];
+	corpus &c = corpora[id];
+
+	if (c.paths.empty()) {
+		// seed per corpus, so adding a corpus won't change the content of any of the others.
+		corpus_generator gen(corpus_seed + (uint64_t)id);
+		c.paths.reserve(corpus_size);
+		for (size_t i = 0; i < corpus_size; i++) {
+			c.paths.push_back(gen.path_for(id));
+			if (c.max_path_length < c.paths.back().size())
+				c.max_path_length = c.paths.back().size();
+		}
+	}
+	return c;
+}
+
+
+// --- benchmark helpers -----------------------------------------------------------------------------
+
+static fz_context *bench_ctx = nullptr;
+
+// Runs `fn` for one path per benchmark iteration, cycling through the corpus, and sets up the reported counters.
+template <typename F>
+static void run_corpus(benchmark::State &state, corpus_id id, F &&fn)
+{
+	const corpus &c = get_corpus(id);
+	const size_t n = c.paths.size();
+	size_t idx = 0;
+	int64_t bytes = 0;
+
+	uint64_t allocs_at_start = bench_alloc_count.load(std::memory_order_relaxed);
+
+	for (auto _ : state) {
+		const std::string &path = c.paths[idx];
+		fn(path);
+		bytes += (int64_t)path.size();
+		if (++idx == n)
+			idx = 0;
+	}
+
+	uint64_t allocs = bench_alloc_count.load(std::memory_order_relaxed) - allocs_at_start;
+
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(bytes);
+	state.counters["time/path"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+#if PATHUTILS_BENCH_COUNTS_ALLOCATIONS
+	state.counters["allocs/path"] = benchmark::Counter((double)allocs, benchmark::Counter::kAvgIterations);
+#else
+	(void)allocs;
+#endif
+	state.SetLabel(corpus_names[id]);
+}
+
+// a minimal path element processor for the CRTP driver: copies each path element verbatim,
+// so we measure the driver overhead itself.
+class BenchPassthroughProcessor: public pathutils::SanitationProcessorBase<BenchPassthroughProcessor> {
+public:
+	std::string process_start(std::string_view &, size_t&) {
+		return {};
+	}
+
+	std::string process_element(const std::string_view input, size_t& offset) {
+		size_t end = input.find('/', offset);
+		if (end == std::string_view::npos)
+			end = input.size();
+		else
+			end++;
+		std::string_view element = input.substr(offset, end - offset);
+		offset = end;
+		return std::string(element);
+	}
+
+	[[nodiscard]] pathutils::ErrorInfoPtr process_end(std::string &, std::string_view &input, size_t offset) {
+		input.remove_prefix(offset);
+		return std::move(error_);
+	}
+
+	bool all_done_or_fail(const std::string_view &input, size_t &offset) {
+		return failed() || offset >= input.size();
+	}
+};
+
+// the same, but appending its output straight into the driver's output_sink.
+class BenchPassthroughSinkProcessor: public pathutils::SanitationProcessorBase<BenchPassthroughSinkProcessor> {
+public:
+	void process_start(std::string_view &, size_t&, pathutils::output_sink &) {
+	}
+
+	void process_element(const std::string_view input, size_t& offset, pathutils::output_sink &output) {
+		size_t end = input.find('/', offset);
+		if (end == std::string_view::npos)
+			end = input.size();
+		else
+			end++;
+		output.append(input.substr(offset, end - offset));
+		offset = end;
+	}
+
+	[[nodiscard]] pathutils::ErrorStatus process_end(pathutils::output_sink &, std::string_view &input, size_t offset) {
+		input.remove_prefix(offset);
+		return take_error_status();
+	}
+
+	bool all_done_or_fail(const std::string_view &input, size_t &offset) {
+		return failed() || offset >= input.size();
+	}
+};
+
+
+// --- the benchmarks --------------------------------------------------------------------------------
+
+static void BM_fz_normalize_path(benchmark::State &state, corpus_id id)
+{
+	std::vector<char> buf(get_corpus(id).max_path_length + 1);
+
+	run_corpus(state, id, [&](const std::string &path) {
+		fz_try(bench_ctx)
+			fz_normalize_path(bench_ctx, buf.data(), buf.size(), path.c_str());
+		fz_catch(bench_ctx)
+		{
+			// illegal `/..` paths are part of the adversarial corpus: we're only timing them here.
+		}
+		benchmark::DoNotOptimize(buf.data());
+	});
+}
+
+static void BM_fz_sanitize_path_ex(benchmark::State &state, corpus_id id)
+{
+	std::vector<char> buf(get_corpus(id).max_path_length + 1);
+
+	run_corpus(state, id, [&](const std::string &path) {
+		// fz_sanitize_path_ex() works in place, so we must copy the input anew every round.
+		memcpy(buf.data(), path.c_str(), path.size() + 1);
+		int rv = fz_sanitize_path_ex(buf.data(), "^$!", "_", 0, buf.size());
+		benchmark::DoNotOptimize(rv);
+		benchmark::DoNotOptimize(buf.data());
+	});
+}
+
+static void BM_fz_sanitize_path_with_policy(benchmark::State &state, corpus_id id)
+{
+	std::vector<char> buf(get_corpus(id).max_path_length + 1);
+	pathutils_sanitize_policy policy;
+	pathutils_compile_sanitize_policy(&policy, "^$!", "_", PATHUTILS_SANITIZE_HASH_FULL_PATH);
+
+	run_corpus(state, id, [&](const std::string &path) {
+		memcpy(buf.data(), path.c_str(), path.size() + 1);
+		int rv = fz_sanitize_path_with_policy(buf.data(), &policy, 0, buf.size());
+		benchmark::DoNotOptimize(rv);
+		benchmark::DoNotOptimize(buf.data());
+	});
+}
+
+static void BM_sanitize_path_string_view(benchmark::State &state, corpus_id id)
+{
+	std::string out;
+	out.reserve(get_corpus(id).max_path_length + 1);
+
+	run_corpus(state, id, [&](const std::string &path) {
+		// the reused output string should keep this benchmark at zero allocs/path.
+		pathutils::sanitize_path(std::string_view(path), out);
+		benchmark::DoNotOptimize(out.data());
+	});
+}
+
+// sanitize_batch() processes the entire corpus in one call, so here each iteration is one corpus run.
+static void BM_sanitize_batch(benchmark::State &state, corpus_id id, unsigned int thread_count)
+{
+	const corpus &c = get_corpus(id);
+	std::vector<std::string_view> paths(c.paths.begin(), c.paths.end());
+	pathutils::output_arena arena;
+	int64_t bytes = 0;
+
+	for (auto _ : state) {
+		pathutils::sanitize_batch(paths, arena, nullptr, thread_count);
+		benchmark::DoNotOptimize(arena.data.data());
+		bytes += (int64_t)arena.offsets.back();
+	}
+
+	state.SetItemsProcessed(state.iterations() * (int64_t)paths.size());
+	state.SetBytesProcessed(bytes);
+}
+
+#if defined(_WIN32) || defined(MSDOS)
+
+static void BM_curl_sanitize_file_name(benchmark::State &state, corpus_id id, int flags)
+{
+	run_corpus(state, id, [&](const std::string &path) {
+		char *sanitized = NULL;
+		CurlSanitizeCode sc = curl_sanitize_file_name(&sanitized, path.c_str(), flags);
+		benchmark::DoNotOptimize(sc);
+		benchmark::DoNotOptimize(sanitized);
+		free(sanitized);
+	});
+}
+
+static void BM_curl_sanitize_file_name_buf(benchmark::State &state, corpus_id id, int flags)
+{
+	std::string out;
+
+	run_corpus(state, id, [&](const std::string &path) {
+		CurlSanitizeCode sc = pathutils::curl_sanitize_file_name(std::string_view(path), out, flags);
+		benchmark::DoNotOptimize(sc);
+		benchmark::DoNotOptimize(out.data());
+	});
+}
+
+#endif
+
+static void BM_is_stdio_path(benchmark::State &state, corpus_id id)
+{
+	run_corpus(state, id, [&](const std::string &path) {
+		auto rv = pathutils::is_stdio_path(path.c_str());
+		benchmark::DoNotOptimize(rv);
+	});
+}
+
+static void BM_crtp_sanitize_driver(benchmark::State &state, corpus_id id)
+{
+	BenchPassthroughProcessor processor;
+
+	run_corpus(state, id, [&](const std::string &path) {
+		auto rv = pathutils::sanitize(path, processor);
+		benchmark::DoNotOptimize(rv.value.data());
+	});
+}
+
+static void BM_crtp_sanitize_driver_sink(benchmark::State &state, corpus_id id)
+{
+	BenchPassthroughSinkProcessor processor;
+	std::string out;
+
+	run_corpus(state, id, [&](const std::string &path) {
+		out.clear();
+		pathutils::output_sink sink(out);
+		auto error = pathutils::sanitize(path, processor, sink);
+		benchmark::DoNotOptimize(out.data());
+		benchmark::DoNotOptimize(error);
+	});
+}
+
+// three passthrough stages fused into one pass: this measures the overhead of the chaining itself.
+static void BM_crtp_sanitize_driver_chain(benchmark::State &state, corpus_id id)
+{
+	pathutils::ProcessorChain<BenchPassthroughSinkProcessor, BenchPassthroughSinkProcessor, BenchPassthroughSinkProcessor> processor;
+	std::string out;
+
+	run_corpus(state, id, [&](const std::string &path) {
+		out.clear();
+		pathutils::output_sink sink(out);
+		auto error = pathutils::sanitize(path, processor, sink);
+		benchmark::DoNotOptimize(out.data());
+		benchmark::DoNotOptimize(error);
+	});
+}
+
+// --- the file stat benchmarks ----------------------------------------------------------------------
+//
+// These run against a scratch tree of 64 directories with 256 files each: in /dev/shm when there is one (any Linux box
+// has that tmpfs), otherwise in the system temp directory. The tree is created on first use and removed at exit.
+
+class stat_tree
+{
+public:
+	std::vector<std::string> paths;
+	std::vector<const char *> cpaths;
+
+	stat_tree()
+	{
+		std::error_code ec;
+		root_ = std::filesystem::is_directory("/dev/shm", ec) ? std::filesystem::path("/dev/shm") : std::filesystem::temp_directory_path();
+		root_ /= "pathutils-bench-stat-tree";
+		std::filesystem::remove_all(root_, ec);
+
+		for (int d = 0; d < 64; d++) {
+			std::filesystem::path dir = root_ / ("d" + std::to_string(d));
+			std::filesystem::create_directories(dir, ec);
+			paths.push_back(dir.string());
+			for (int f = 0; f < 256; f++) {
+				std::filesystem::path file = dir / ("f" + std::to_string(f) + ".dat");
+				std::ofstream(file) << std::string((size_t)(d * f) % 512, 'x');
+				paths.push_back(file.string());
+			}
+		}
+		for (const auto &p : paths)
+			cpaths.push_back(p.c_str());
+	}
+
+	~stat_tree()
+	{
+		std::error_code ec;
+		std::filesystem::remove_all(root_, ec);
+	}
+
+private:
+	std::filesystem::path root_;
+};
+
+static const stat_tree &get_stat_tree(void)
+{
+	static stat_tree tree;
+	return tree;
+}
+
+static void BM_fz_stat_info(benchmark::State &state, unsigned int mask)
+{
+	const stat_tree &tree = get_stat_tree();
+	fz_file_info info;
+
+	for (auto _ : state) {
+		for (const char *path : tree.cpaths) {
+			int rv = fz_stat_info(bench_ctx, path, &info, mask);
+			benchmark::DoNotOptimize(rv);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * (int64_t)tree.cpaths.size());
+}
+
+static void BM_fz_stat_many(benchmark::State &state, unsigned int mask)
+{
+	const stat_tree &tree = get_stat_tree();
+	std::vector<fz_file_info> infos(tree.cpaths.size());
+
+	for (auto _ : state) {
+		size_t failed = fz_stat_many(bench_ctx, tree.cpaths.data(), tree.cpaths.size(), infos.data(), mask);
+		benchmark::DoNotOptimize(failed);
+		benchmark::DoNotOptimize(infos.data());
+	}
+	state.SetItemsProcessed(state.iterations() * (int64_t)tree.cpaths.size());
+}
+
+static void BM_fz_fopen_utf8(benchmark::State &state)
+{
+	const stat_tree &tree = get_stat_tree();
+
+	for (auto _ : state) {
+		for (const char *path : tree.cpaths) {
+			FILE *f = fz_fopen_utf8(bench_ctx, path, "rb");
+			if (f)
+				fclose(f);
+			benchmark::DoNotOptimize(f);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * (int64_t)tree.cpaths.size());
+}
+
+#if !defined(_WIN32)
+// the same files, opened by name relative to their (once opened) directory.
+static void BM_dir_handle_fopen(benchmark::State &state)
+{
+	const stat_tree &tree = get_stat_tree();
+	std::vector<pathutils::dir_handle> dirs;
+	std::vector<std::pair<size_t, std::string>> files;
+	for (const auto &p : tree.paths) {
+		std::filesystem::path path(p);
+		if (std::filesystem::is_directory(path)) {
+			dirs.push_back(pathutils::dir_handle::open(p.c_str()));
+			continue;
+		}
+		files.emplace_back(dirs.size() - 1, path.filename().string());
+	}
+
+	for (auto _ : state) {
+		for (const auto &[dir, name] : files) {
+			FILE *f = dirs[dir].fopen(name.c_str(), "rb");
+			if (f)
+				fclose(f);
+			benchmark::DoNotOptimize(f);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * (int64_t)files.size());
+}
+#endif
+
+// --- the no-clobber output file benchmarks --------------------------------------------------------
+//
+// Save `state.range(0)` files which all want to be called `index.html` into an empty directory, as a crawler does.
+// The `cold` variant forgets the remembered next free number before every file, so each one has to be searched for.
+
+#if !defined(_WIN32)
+static void BM_open_unique_file(benchmark::State &state, bool cold)
+{
+	std::error_code ec;
+	std::filesystem::path dir = std::filesystem::is_directory("/dev/shm", ec) ? std::filesystem::path("/dev/shm") : std::filesystem::temp_directory_path();
+	dir /= "pathutils-bench-unique-names";
+	const std::string path = (dir / "index.html").string();
+	const size_t ext_pos = path.size() - strlen(".html");
+	std::vector<char> name(path.size() + 16);
+	const int64_t count = state.range(0);
+
+	for (auto _ : state) {
+		state.PauseTiming();
+		std::filesystem::remove_all(dir, ec);
+		std::filesystem::create_directories(dir, ec);
+		pathutils_unique_names_clear();
+		state.ResumeTiming();
+
+		for (int64_t i = 0; i < count; i++) {
+			if (cold)
+				pathutils_unique_names_clear();
+			int fd = pathutils_open_unique_file(path.c_str(), ext_pos, "", O_WRONLY, 0666, name.data(), name.size());
+			if (fd != -1)
+				close(fd);
+			benchmark::DoNotOptimize(fd);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+
+	std::filesystem::remove_all(dir, ec);
+	pathutils_unique_names_clear();
+}
+#endif
+
+static void register_benchmarks(void)
+{
+	for (int i = 0; i < CORPUS_COUNT; i++) {
+		corpus_id id = (corpus_id)i;
+		std::string suffix = std::string("/") + corpus_names[id];
+
+		benchmark::RegisterBenchmark(("fz_normalize_path" + suffix).c_str(), BM_fz_normalize_path, id);
+		benchmark::RegisterBenchmark(("fz_sanitize_path_ex" + suffix).c_str(), BM_fz_sanitize_path_ex, id);
+		benchmark::RegisterBenchmark(("fz_sanitize_path_with_policy" + suffix).c_str(), BM_fz_sanitize_path_with_policy, id);
+		benchmark::RegisterBenchmark(("sanitize_path/string_view" + suffix).c_str(), BM_sanitize_path_string_view, id);
+		benchmark::RegisterBenchmark(("sanitize_batch/1_thread" + suffix).c_str(), BM_sanitize_batch, id, 1U)->UseRealTime();
+		benchmark::RegisterBenchmark(("sanitize_batch/all_threads" + suffix).c_str(), BM_sanitize_batch, id, 0U)->UseRealTime();
+#if defined(_WIN32) || defined(MSDOS)
+		benchmark::RegisterBenchmark(("curl_sanitize_file_name" + suffix).c_str(), BM_curl_sanitize_file_name, id, 0);
+		benchmark::RegisterBenchmark(("curl_sanitize_file_name/relative_path" + suffix).c_str(), BM_curl_sanitize_file_name, id, CURL_SANITIZE_ALLOW_ONLY_RELATIVE_PATH);
+		benchmark::RegisterBenchmark(("curl_sanitize_file_name/buf" + suffix).c_str(), BM_curl_sanitize_file_name_buf, id, 0);
+#endif
+		benchmark::RegisterBenchmark(("is_stdio_path" + suffix).c_str(), BM_is_stdio_path, id);
+		benchmark::RegisterBenchmark(("sanitize_driver" + suffix).c_str(), BM_crtp_sanitize_driver, id);
+		benchmark::RegisterBenchmark(("sanitize_driver/output_sink" + suffix).c_str(), BM_crtp_sanitize_driver_sink, id);
+		benchmark::RegisterBenchmark(("sanitize_driver/chain3" + suffix).c_str(), BM_crtp_sanitize_driver_chain, id);
+	}
+
+	benchmark::RegisterBenchmark("fz_stat_info/all", BM_fz_stat_info, FZ_STAT_ALL);
+	benchmark::RegisterBenchmark("fz_stat_info/size", BM_fz_stat_info, FZ_STAT_SIZE);
+	benchmark::RegisterBenchmark("fz_stat_many/all", BM_fz_stat_many, FZ_STAT_ALL)->UseRealTime();
+	benchmark::RegisterBenchmark("fz_stat_many/size", BM_fz_stat_many, FZ_STAT_SIZE)->UseRealTime();
+	benchmark::RegisterBenchmark("fz_fopen_utf8", BM_fz_fopen_utf8);
+#if !defined(_WIN32)
+	benchmark::RegisterBenchmark("dir_handle/fopen", BM_dir_handle_fopen);
+	benchmark::RegisterBenchmark("open_unique_file/warm", BM_open_unique_file, false)->Arg(100)->Arg(2000);
+	benchmark::RegisterBenchmark("open_unique_file/cold", BM_open_unique_file, true)->Arg(100)->Arg(2000);
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main  pathutils_bench_main
+#endif
+
+int main(int argc, const char** argv)
+{
+#if PATHUTILS_BENCH_COUNTS_ALLOCATIONS && defined(_MSC_VER)
+	_CrtSetAllocHook(bench_alloc_hook);
+#endif
+
+	bench_ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+	if (!bench_ctx) {
+		fprintf(stderr, "cannot create mupdf context\n");
+		return EXIT_FAILURE;
+	}
+
+	register_benchmarks();
+
+	benchmark::Initialize(&argc, (char **)argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, (char **)argv)) {
+		fz_drop_context(bench_ctx);
+		return EXIT_FAILURE;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	fz_drop_context(bench_ctx);
+	return EXIT_SUCCESS;
+}
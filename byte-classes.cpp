@@ -0,0 +1,97 @@
+
+#include <stdio.h>
+
+#include "pathutils.h"
+
+// The byte classification table shared by all the sanitizers.
+//
+// Each sanitizer used to classify every input byte through its own chain of `strchr()` calls
+// against its own banned character set. Instead, every byte value is now classified once, at
+// compile time, into a set of class bits (see the PATHUTILS_BYTECLASS_* defines in pathutils.h)
+// and each sanitizer merely tests the byte against its own PATHUTILS_BYTEPROFILE_* mask:
+// one table load and one AND per byte, whatever the size of the banned set.
+//
+// This is also the single place where the banned sets of the various sanitizers are defined.
+
+namespace pathutils {
+
+	namespace {
+
+		struct byteclass_table
+		{
+			pathutils_byteclass_t cls[256];
+		};
+
+		constexpr void mark_byteclass(byteclass_table &t, const char *set, pathutils_byteclass_t bits)
+		{
+			for (; *set; set++)
+				t.cls[(unsigned char)*set] |= bits;
+		}
+
+		constexpr byteclass_table make_byteclass_table()
+		{
+			byteclass_table t{};
+
+			for (int c = 0; c < 256; c++) {
+				pathutils_byteclass_t bits = 0;
+
+				if (c < ' ')
+					bits |= PATHUTILS_BYTECLASS_CONTROL;
+				else if (c == 0x7F)
+					bits |= PATHUTILS_BYTECLASS_DEL;
+				else if (c == ' ')
+					bits |= PATHUTILS_BYTECLASS_SPACE;
+				else if (c >= '0' && c <= '9')
+					bits |= PATHUTILS_BYTECLASS_DIGIT | PATHUTILS_BYTECLASS_PLAIN;
+				else if (c >= 'A' && c <= 'Z')
+					bits |= PATHUTILS_BYTECLASS_UPPER | PATHUTILS_BYTECLASS_PLAIN;
+				else if (c >= 'a' && c <= 'z')
+					bits |= PATHUTILS_BYTECLASS_LOWER | PATHUTILS_BYTECLASS_PLAIN;
+				else if (c >= 0x80) {
+					bits |= PATHUTILS_BYTECLASS_HIGH;
+					if (c <= 0x9F)
+						bits |= PATHUTILS_BYTECLASS_C1_CONTROL;
+				}
+
+				t.cls[c] = bits;
+			}
+
+			mark_byteclass(t, "_()", PATHUTILS_BYTECLASS_PLAIN);
+			mark_byteclass(t, "/\\", PATHUTILS_BYTECLASS_PATHSEP);
+			mark_byteclass(t, ".", PATHUTILS_BYTECLASS_DOT);
+			mark_byteclass(t, ":", PATHUTILS_BYTECLASS_COLON);
+			mark_byteclass(t, "{[<", PATHUTILS_BYTECLASS_BRACE_OPEN);
+			mark_byteclass(t, "}]>", PATHUTILS_BYTECLASS_BRACE_CLOSE);
+
+			mark_byteclass(t, "`\"*@=|;?:", PATHUTILS_BYTECLASS_FZ_BANNED);
+			mark_byteclass(t, "|<>\"&'~`?*$^;#%", PATHUTILS_BYTECLASS_CURL_BANNED);
+			mark_byteclass(t, "$~%^&*?|;:'\"<>`", PATHUTILS_BYTECLASS_LEPT_BANNED);
+			mark_byteclass(t, "?<>:*|\"", PATHUTILS_BYTECLASS_CROW_BANNED);
+
+			return t;
+		}
+
+		constexpr byteclass_table byteclasses = make_byteclass_table();
+
+		// a few sanity checks, which double as documentation:
+		static_assert(byteclasses.cls[0] == PATHUTILS_BYTECLASS_CONTROL);
+		static_assert(byteclasses.cls['a'] == (PATHUTILS_BYTECLASS_LOWER | PATHUTILS_BYTECLASS_PLAIN));
+		static_assert(byteclasses.cls['('] == PATHUTILS_BYTECLASS_PLAIN);
+		static_assert(byteclasses.cls['<'] == (PATHUTILS_BYTECLASS_BRACE_OPEN | PATHUTILS_BYTECLASS_CURL_BANNED | PATHUTILS_BYTECLASS_LEPT_BANNED | PATHUTILS_BYTECLASS_CROW_BANNED));
+		static_assert(byteclasses.cls[0x9F] == (PATHUTILS_BYTECLASS_HIGH | PATHUTILS_BYTECLASS_C1_CONTROL));
+		static_assert(byteclasses.cls[0xA0] == PATHUTILS_BYTECLASS_HIGH);
+		static_assert((byteclasses.cls['-'] & PATHUTILS_BYTEPROFILE_FZ) == 0);
+	}
+
+}
+
+// C has no constexpr, so we expand the generated table into a plain array initializer for the C-side API.
+#define PATHUTILS_BYTECLASS_1(i)      pathutils::byteclasses.cls[i]
+#define PATHUTILS_BYTECLASS_4(i)      PATHUTILS_BYTECLASS_1(i), PATHUTILS_BYTECLASS_1(i + 1), PATHUTILS_BYTECLASS_1(i + 2), PATHUTILS_BYTECLASS_1(i + 3)
+#define PATHUTILS_BYTECLASS_16(i)     PATHUTILS_BYTECLASS_4(i), PATHUTILS_BYTECLASS_4(i + 4), PATHUTILS_BYTECLASS_4(i + 8), PATHUTILS_BYTECLASS_4(i + 12)
+#define PATHUTILS_BYTECLASS_64(i)     PATHUTILS_BYTECLASS_16(i), PATHUTILS_BYTECLASS_16(i + 16), PATHUTILS_BYTECLASS_16(i + 32), PATHUTILS_BYTECLASS_16(i + 48)
+#define PATHUTILS_BYTECLASS_256(i)    PATHUTILS_BYTECLASS_64(i), PATHUTILS_BYTECLASS_64(i + 64), PATHUTILS_BYTECLASS_64(i + 128), PATHUTILS_BYTECLASS_64(i + 192)
+
+extern "C" const pathutils_byteclass_t pathutils_byteclass_table[256] = {
+	PATHUTILS_BYTECLASS_256(0)
+};
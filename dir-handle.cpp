@@ -0,0 +1,163 @@
+#include "pathutils.hpp"
+#include "pathutils.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// pathutils::dir_handle: file operations relative to an open directory; see pathutils.hpp.
+
+namespace pathutils {
+
+	namespace {
+
+		constexpr int dir_open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+		// Translate a fopen() mode string to open() flags; return -1 for an invalid mode.
+		int fopen_mode_flags(const char *mode)
+		{
+			int flags;
+			switch (*mode) {
+			case 'r':
+				flags = 0;
+				break;
+			case 'w':
+				flags = O_CREAT | O_TRUNC;
+				break;
+			case 'a':
+				flags = O_CREAT | O_APPEND;
+				break;
+			default:
+				return -1;
+			}
+
+			bool update = false;
+			for (const char *m = mode + 1; *m; m++) {
+				switch (*m) {
+				case '+':
+					update = true;
+					break;
+				case 'x':
+					flags |= O_EXCL;
+					break;
+				case 'e':
+					flags |= O_CLOEXEC;
+					break;
+				default:
+					// 'b', 't' and the like: no meaning here.
+					break;
+				}
+			}
+
+			if (update)
+				flags |= O_RDWR;
+			else
+				flags |= (*mode == 'r') ? O_RDONLY : O_WRONLY;
+			return flags;
+		}
+
+	}
+
+	dir_handle::~dir_handle()
+	{
+		close();
+	}
+
+	dir_handle::dir_handle(dir_handle &&other) noexcept
+		: fd_(other.fd_)
+	{
+		other.fd_ = -1;
+	}
+
+	dir_handle &dir_handle::operator=(dir_handle &&other) noexcept
+	{
+		if (this != &other) {
+			close();
+			fd_ = other.fd_;
+			other.fd_ = -1;
+		}
+		return *this;
+	}
+
+	dir_handle dir_handle::open(const char *path)
+	{
+		return dir_handle(::open(path, dir_open_flags));
+	}
+
+	void dir_handle::close()
+	{
+		if (fd_ >= 0) {
+			::close(fd_);
+			fd_ = -1;
+		}
+	}
+
+	dir_handle dir_handle::subdir(const char *name, bool create) const
+	{
+		// try to open it first: the common case is that it already exists.
+		int fd = ::openat(fd_, name, dir_open_flags);
+		if (fd < 0 && create && errno == ENOENT) {
+			if (::mkdirat(fd_, name, 0777) == 0 || errno == EEXIST)
+				fd = ::openat(fd_, name, dir_open_flags);
+		}
+		return dir_handle(fd);
+	}
+
+	int dir_handle::open_file(const char *name, int flags, int mode) const
+	{
+		return ::openat(fd_, name, flags, mode);
+	}
+
+	FILE *dir_handle::fopen(const char *name, const char *mode) const
+	{
+		int flags = fopen_mode_flags(mode);
+		if (flags < 0) {
+			errno = EINVAL;
+			return nullptr;
+		}
+
+		int fd = ::openat(fd_, name, flags, 0666);
+		if (fd < 0)
+			return nullptr;
+
+		FILE *f = ::fdopen(fd, mode);
+		if (!f) {
+			int e = errno;
+			::close(fd);
+			errno = e;
+		}
+		return f;
+	}
+
+	int dir_handle::mkdir(const char *name, int mode) const
+	{
+		return ::mkdirat(fd_, name, mode);
+	}
+
+	int dir_handle::remove(const char *name) const
+	{
+		if (::unlinkat(fd_, name, 0) == 0)
+			return 0;
+		// a directory? Linux says EISDIR, POSIX says EPERM.
+		if (errno != EISDIR && errno != EPERM)
+			return -1;
+		int e = errno;
+		if (::unlinkat(fd_, name, AT_REMOVEDIR) == 0)
+			return 0;
+		if (errno == ENOTDIR)
+			errno = e;
+		return -1;
+	}
+
+	int dir_handle::stat(const char *name, fz_file_info *info, unsigned int mask) const
+	{
+		return pathutils_stat_info_at(fd_, name, info, mask);
+	}
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iterator>
+
+#include "pathutils.h"
+
+// The reserved MSDOS/Windows device names matcher shared by all the sanitizers.
+//
+// The sanitizers used to each detect these names in their own way, with a series of strnicmp() calls per
+// candidate, and they disagreed on the details, e.g. on COM0 or CLOCK$. Now they all ask
+// pathutils_match_dos_device(), which packs the first four bytes of the name, folded to upper case, into
+// a single integer, finds the last table entry not above it and does one masked compare against that:
+// three letter devices ignore the fourth byte, the numbered devices have an entry per digit, and CLOCK$
+// matches on `CLOC` before checking the last two bytes.
+//
+// What may follow a device name (an extension, a colon, spaces) is not the same for every sanitizer,
+// so that is left to the callers: the matcher reports the length of the device name it matched.
+//
+// This is also the single place where the set of reserved device names is defined.
+
+namespace pathutils {
+
+	namespace {
+
+		constexpr uint32_t pack4(const char *s)
+		{
+			return ((uint32_t)(unsigned char)s[0] << 24) | ((uint32_t)(unsigned char)s[1] << 16) | ((uint32_t)(unsigned char)s[2] << 8) | (uint32_t)(unsigned char)s[3];
+		}
+
+		inline uint32_t fold_upper(char c)
+		{
+			unsigned char u = (unsigned char)c;
+			return (u >= 'a' && u <= 'z') ? u - ('a' - 'A') : u;
+		}
+
+		constexpr uint32_t MATCH_3 = 0xFFFFFF00;   // three letter device: the fourth byte is whatever follows it
+		constexpr uint32_t MATCH_4 = 0xFFFFFFFF;
+
+		struct dos_device_entry
+		{
+			uint32_t key;                    // first four characters, packed: see pack4()
+			uint32_t mask;
+			pathutils_dos_device device;
+			const char *tail;                // what must follow the key, case-insensitive
+		};
+
+		// sorted by key. For every name the search can land on only one entry which may match it, as no other
+		// entry shares the first three bytes of a MATCH_3 entry.
+		constexpr dos_device_entry dos_devices[] = {
+			{ pack4("AUX\0"), MATCH_3, PATHUTILS_DOS_DEVICE_AUX, "" },
+			{ pack4("CLOC"), MATCH_4, PATHUTILS_DOS_DEVICE_CLOCK, "K$" },
+			{ pack4("COM0"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM1"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM2"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM3"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM4"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM5"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM6"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM7"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM8"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("COM9"), MATCH_4, PATHUTILS_DOS_DEVICE_COM, "" },
+			{ pack4("CON\0"), MATCH_3, PATHUTILS_DOS_DEVICE_CON, "" },
+			{ pack4("LPT0"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT1"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT2"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT3"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT4"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT5"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT6"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT7"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT8"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("LPT9"), MATCH_4, PATHUTILS_DOS_DEVICE_LPT, "" },
+			{ pack4("NUL\0"), MATCH_3, PATHUTILS_DOS_DEVICE_NUL, "" },
+			{ pack4("PRN\0"), MATCH_3, PATHUTILS_DOS_DEVICE_PRN, "" },
+		};
+
+		static_assert(std::is_sorted(std::begin(dos_devices), std::end(dos_devices), [](const dos_device_entry &a, const dos_device_entry &b) {
+			return a.key < b.key;
+		}));
+
+	}
+
+}
+
+using namespace pathutils;
+
+extern "C" pathutils_dos_device pathutils_match_dos_device(const char *name, size_t len, size_t *match_len)
+{
+	*match_len = 0;
+	if (len < 3)
+		return PATHUTILS_DOS_DEVICE_NONE;
+
+	uint32_t key = (fold_upper(name[0]) << 24) | (fold_upper(name[1]) << 16) | (fold_upper(name[2]) << 8) | (len > 3 ? fold_upper(name[3]) : 0);
+	const dos_device_entry *e = std::upper_bound(std::begin(dos_devices), std::end(dos_devices), key, [](uint32_t key, const dos_device_entry &entry) {
+		return key < entry.key;
+	});
+	if (e == std::begin(dos_devices))
+		return PATHUTILS_DOS_DEVICE_NONE;
+	e--;
+	if ((key & e->mask) != e->key)
+		return PATHUTILS_DOS_DEVICE_NONE;
+
+	size_t n = (e->mask == MATCH_3) ? 3 : 4;
+	for (const char *t = e->tail; *t; t++, n++) {
+		if (n >= len || fold_upper(name[n]) != (unsigned char)*t)
+			return PATHUTILS_DOS_DEVICE_NONE;
+	}
+
+	*match_len = n;
+	return e->device;
+}
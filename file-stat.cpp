@@ -0,0 +1,444 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "pathutils.h"
+
+// pathutils_stat_info() and fz_stat_many(): file attributes, one stat per path, many paths at once.
+//
+// On POSIX systems the actual work is done by pathutils_stat_info(), which needs no fz_context and can therefore be
+// used from any thread. On Linux it uses statx(), which lets the filesystem skip fetching the attributes we don't ask for.
+//
+// fz_stat_many() is meant for directory-sync style workloads, where a stat per file, one at a time, leaves us waiting
+// for each (network or cold cache) metadata lookup in turn. Instead we keep many lookups in flight at once:
+//
+// - on Linux (5.6+), all statx() calls are submitted through an io_uring, with up to `max_ring_entries` in flight,
+//   and the results are written to `infos[]` as they complete;
+// - elsewhere, or when io_uring is not available (old kernel, or disabled by a seccomp filter as in many containers),
+//   a pool of worker threads grabs the paths in small chunks and stats them the ordinary way;
+// - on Windows the paths are processed on the calling thread, as the path conversions need the fz_context.
+//
+// Either way, `infos[i]` always belongs to `paths[i]`.
+
+#if defined(__linux__) && defined(STATX_TYPE) && defined(IORING_OFF_SQ_RING) && defined(__NR_io_uring_setup)
+#define PATHUTILS_HAVE_IO_URING    1
+#endif
+
+namespace pathutils {
+
+	namespace {
+
+		// don't bother setting up a ring or threads for fewer paths than this: the set-up would cost more than it saves.
+		constexpr size_t min_paths_for_batching = 32;
+		// ...and hand out the paths to the worker threads in chunks of this size.
+		constexpr size_t paths_per_chunk = 16;
+		// stat is latency bound, not CPU bound: use more threads than we have cores.
+		constexpr unsigned int threads_per_core = 4;
+
+#if !defined(_WIN32)
+
+		void info_from_stat(const struct stat &st, fz_file_info *info)
+		{
+			info->valid = FZ_STAT_ALL;
+			info->is_regular_file = S_ISREG(st.st_mode);
+			info->is_directory = S_ISDIR(st.st_mode);
+			// directories should be reported as size=0 or 1...
+			info->size = info->is_regular_file ? (int64_t)st.st_size : 0;
+			info->atime = st.st_atime;
+			info->mtime = st.st_mtime;
+			info->ctime = st.st_ctime;
+		}
+
+#if defined(__linux__) && defined(STATX_TYPE)
+
+		// the file type is always included, as we need it to report the size.
+		unsigned int statx_mask(unsigned int mask)
+		{
+			unsigned int want = STATX_TYPE;
+			if (mask & FZ_STAT_SIZE)
+				want |= STATX_SIZE;
+			if (mask & FZ_STAT_ATIME)
+				want |= STATX_ATIME;
+			if (mask & FZ_STAT_MTIME)
+				want |= STATX_MTIME;
+			if (mask & FZ_STAT_CTIME)
+				want |= STATX_CTIME;
+			return want;
+		}
+
+		void info_from_statx(const struct statx &stx, unsigned int mask, fz_file_info *info)
+		{
+			info->valid = FZ_STAT_TYPE;
+			info->is_regular_file = S_ISREG(stx.stx_mode);
+			info->is_directory = S_ISDIR(stx.stx_mode);
+			if ((mask & FZ_STAT_SIZE) && (stx.stx_mask & STATX_SIZE)) {
+				info->valid |= FZ_STAT_SIZE;
+				info->size = info->is_regular_file ? (int64_t)stx.stx_size : 0;
+			}
+			if ((mask & FZ_STAT_ATIME) && (stx.stx_mask & STATX_ATIME)) {
+				info->valid |= FZ_STAT_ATIME;
+				info->atime = stx.stx_atime.tv_sec;
+			}
+			if ((mask & FZ_STAT_MTIME) && (stx.stx_mask & STATX_MTIME)) {
+				info->valid |= FZ_STAT_MTIME;
+				info->mtime = stx.stx_mtime.tv_sec;
+			}
+			if ((mask & FZ_STAT_CTIME) && (stx.stx_mask & STATX_CTIME)) {
+				info->valid |= FZ_STAT_CTIME;
+				info->ctime = stx.stx_ctime.tv_sec;
+			}
+		}
+
+#endif
+
+		size_t stat_range(const char *const *paths, size_t first, size_t last, fz_file_info *infos, unsigned int mask)
+		{
+			size_t failed = 0;
+			for (size_t i = first; i < last; i++) {
+				if (pathutils_stat_info(paths[i], &infos[i], mask))
+					failed++;
+			}
+			return failed;
+		}
+
+		// The worker pool fallback: the workers (and the calling thread) grab chunks of paths until none are left.
+		size_t stat_with_pool(const char *const *paths, size_t n, fz_file_info *infos, unsigned int mask)
+		{
+			std::atomic<size_t> next{0};
+			std::atomic<size_t> failed{0};
+
+			auto worker = [&]() {
+				size_t f = 0;
+				for (;;) {
+					size_t first = next.fetch_add(paths_per_chunk, std::memory_order_relaxed);
+					if (first >= n)
+						break;
+					f += stat_range(paths, first, std::min(first + paths_per_chunk, n), infos, mask);
+				}
+				failed.fetch_add(f, std::memory_order_relaxed);
+			};
+
+			unsigned int thread_count = std::max(1U, std::thread::hardware_concurrency()) * threads_per_core;
+			size_t worker_count = std::min<size_t>(thread_count, (n + min_paths_for_batching - 1) / min_paths_for_batching) - 1;
+
+			// when we cannot get (enough) threads, the calling thread does the remaining work itself.
+			std::vector<std::thread> workers;
+			workers.reserve(worker_count);
+			try {
+				for (size_t k = 0; k < worker_count; k++)
+					workers.emplace_back(worker);
+			}
+			catch (const std::system_error &) {
+			}
+			worker();
+			for (auto &w : workers)
+				w.join();
+
+			return failed.load(std::memory_order_relaxed);
+		}
+
+#endif
+
+#if PATHUTILS_HAVE_IO_URING
+
+		constexpr unsigned int max_ring_entries = 256;
+
+		// A bare-bones io_uring, just enough to run a batch of IORING_OP_STATX requests; see io_uring(7).
+		class stat_ring
+		{
+		public:
+			~stat_ring()
+			{
+				if (sqes_ != MAP_FAILED)
+					munmap(sqes_, sqes_size_);
+				if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+					munmap(cq_ring_, cq_ring_size_);
+				if (sq_ring_ != MAP_FAILED)
+					munmap(sq_ring_, sq_ring_size_);
+				if (fd_ >= 0)
+					close(fd_);
+			}
+
+			// Return false when io_uring, or its STATX operation, is not available.
+			bool setup(unsigned int entries)
+			{
+				struct io_uring_params p;
+				memset(&p, 0, sizeof(p));
+				fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+				if (fd_ < 0)
+					return false;
+
+				sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+				cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+				if (p.features & IORING_FEAT_SINGLE_MMAP)
+					sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+				sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+
+				sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+				if (sq_ring_ == MAP_FAILED)
+					return false;
+				if (p.features & IORING_FEAT_SINGLE_MMAP)
+					cq_ring_ = sq_ring_;
+				else
+					cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+				if (cq_ring_ == MAP_FAILED)
+					return false;
+				sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+				if (sqes_ == MAP_FAILED)
+					return false;
+
+				char *sq = (char *)sq_ring_;
+				char *cq = (char *)cq_ring_;
+				sq_head_ = (unsigned int *)(sq + p.sq_off.head);
+				sq_tail_ = (unsigned int *)(sq + p.sq_off.tail);
+				sq_mask_ = *(unsigned int *)(sq + p.sq_off.ring_mask);
+				sq_array_ = (unsigned int *)(sq + p.sq_off.array);
+				cq_head_ = (unsigned int *)(cq + p.cq_off.head);
+				cq_tail_ = (unsigned int *)(cq + p.cq_off.tail);
+				cq_mask_ = *(unsigned int *)(cq + p.cq_off.ring_mask);
+				cqes_ = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+				entries_ = p.sq_entries;
+
+				return supports_statx();
+			}
+
+			// Stat all `n` paths; return the number of paths which could not be stat-ed, or -1 when the ring itself failed.
+			//
+			// When the ring fails, the requests which are still in flight are waited for before we return: until they have
+			// completed, the kernel may still write to their `results[]` buffers.
+			ptrdiff_t run(const char *const *paths, size_t n, fz_file_info *infos, unsigned int mask)
+			{
+				const unsigned int want = statx_mask(mask);
+				std::unique_ptr<struct statx[]> results(new struct statx[entries_]);
+				std::vector<size_t> slot_path(entries_);
+				std::vector<unsigned int> free_slots(entries_);
+				for (unsigned int s = 0; s < entries_; s++)
+					free_slots[s] = entries_ - 1 - s;
+
+				size_t next = 0;
+				size_t unsubmitted = 0;
+				size_t in_flight = 0;
+				size_t failed = 0;
+
+				while (next < n || unsubmitted || in_flight) {
+					// queue as many requests as we have free slots for:
+					unsigned int tail = *sq_tail_;
+					while (next < n && !free_slots.empty()) {
+						unsigned int slot = free_slots.back();
+						free_slots.pop_back();
+						slot_path[slot] = next;
+
+						unsigned int index = tail & sq_mask_;
+						struct io_uring_sqe &sqe = ((struct io_uring_sqe *)sqes_)[index];
+						memset(&sqe, 0, sizeof(sqe));
+						sqe.opcode = IORING_OP_STATX;
+						sqe.fd = AT_FDCWD;
+						sqe.addr = (uintptr_t)paths[next];
+						sqe.len = want;
+						sqe.statx_flags = AT_STATX_SYNC_AS_STAT;
+						sqe.off = (uintptr_t)&results[slot];
+						sqe.user_data = slot;
+						sq_array_[index] = index;
+
+						tail++;
+						next++;
+						unsubmitted++;
+					}
+					std::atomic_ref<unsigned int>(*sq_tail_).store(tail, std::memory_order_release);
+
+					// submit them and wait for at least one to complete:
+					int rv = (int)syscall(__NR_io_uring_enter, fd_, (unsigned int)unsubmitted, 1U, IORING_ENTER_GETEVENTS, nullptr, 0);
+					if (rv < 0) {
+						if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+							continue;
+						// wait for the requests in flight; when even that fails, we cannot tell when the kernel is done with
+						// `results`, so we leak it rather than have it written to after it's been freed.
+						if (!drain(in_flight))
+							(void)results.release();
+						return -1;
+					}
+					unsubmitted -= rv;
+					in_flight += rv;
+
+					// collect the results:
+					unsigned int head = *cq_head_;
+					unsigned int cq_tail = std::atomic_ref<unsigned int>(*cq_tail_).load(std::memory_order_acquire);
+					for (; head != cq_tail; head++) {
+						const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+						unsigned int slot = (unsigned int)cqe.user_data;
+						fz_file_info *info = &infos[slot_path[slot]];
+
+						memset(info, 0, sizeof(*info));
+						if (cqe.res < 0) {
+							info->error = -cqe.res;
+							failed++;
+						}
+						else {
+							info_from_statx(results[slot], mask, info);
+						}
+						free_slots.push_back(slot);
+						in_flight--;
+					}
+					std::atomic_ref<unsigned int>(*cq_head_).store(head, std::memory_order_release);
+				}
+
+				return (ptrdiff_t)failed;
+			}
+
+		private:
+			// Wait for the `in_flight` submitted requests to complete, discarding their results. Return false when we cannot.
+			bool drain(size_t in_flight)
+			{
+				for (;;) {
+					unsigned int head = *cq_head_;
+					unsigned int cq_tail = std::atomic_ref<unsigned int>(*cq_tail_).load(std::memory_order_acquire);
+					for (; head != cq_tail && in_flight; head++)
+						in_flight--;
+					std::atomic_ref<unsigned int>(*cq_head_).store(head, std::memory_order_release);
+					if (!in_flight)
+						return true;
+
+					int rv = (int)syscall(__NR_io_uring_enter, fd_, 0U, 1U, IORING_ENTER_GETEVENTS, nullptr, 0);
+					if (rv < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+						return false;
+				}
+			}
+
+			bool supports_statx()
+			{
+				std::vector<unsigned char> buf(sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op));
+				struct io_uring_probe *probe = (struct io_uring_probe *)buf.data();
+				if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+					return false;
+				return probe->last_op >= IORING_OP_STATX && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+			}
+
+			int fd_ = -1;
+			void *sq_ring_ = MAP_FAILED;
+			void *cq_ring_ = MAP_FAILED;
+			void *sqes_ = MAP_FAILED;
+			size_t sq_ring_size_ = 0;
+			size_t cq_ring_size_ = 0;
+			size_t sqes_size_ = 0;
+			unsigned int *sq_head_ = nullptr;
+			unsigned int *sq_tail_ = nullptr;
+			unsigned int *sq_array_ = nullptr;
+			unsigned int sq_mask_ = 0;
+			unsigned int *cq_head_ = nullptr;
+			unsigned int *cq_tail_ = nullptr;
+			unsigned int cq_mask_ = 0;
+			struct io_uring_cqe *cqes_ = nullptr;
+			unsigned int entries_ = 0;
+		};
+
+		// once io_uring turns out to be unavailable, we don't try again.
+		std::atomic<bool> io_uring_unavailable{false};
+
+#endif
+
+	}
+
+}
+
+using namespace pathutils;
+
+#if !defined(_WIN32)
+
+extern "C" int pathutils_stat_info(const char *path, fz_file_info *info, unsigned int mask)
+{
+	return pathutils_stat_info_at(AT_FDCWD, path, info, mask);
+}
+
+extern "C" int pathutils_stat_info_at(int dirfd, const char *path, fz_file_info *info, unsigned int mask)
+{
+	if (!mask)
+		mask = FZ_STAT_ALL;
+	memset(info, 0, sizeof(*info));
+
+	if (path == NULL) {
+		info->error = errno = EINVAL;
+		return -1;
+	}
+
+#if defined(__linux__) && defined(STATX_TYPE)
+	struct statx stx;
+	if (statx(dirfd, path, AT_STATX_SYNC_AS_STAT, statx_mask(mask), &stx) == 0) {
+		info_from_statx(stx, mask, info);
+		return 0;
+	}
+	if (errno != ENOSYS) {
+		info->error = errno;
+		return -1;
+	}
+	// kernel without statx(): fall back to stat().
+#endif
+
+	struct stat st;
+	if (fstatat(dirfd, path, &st, 0)) {
+		info->error = errno;
+		return -1;
+	}
+	info_from_stat(st, info);
+	return 0;
+}
+
+#endif
+
+extern "C" size_t fz_stat_many(struct fz_context *ctx, const char *const *paths, size_t n, fz_file_info *infos, unsigned int mask)
+{
+	if (!mask)
+		mask = FZ_STAT_ALL;
+
+#if defined(_WIN32)
+	size_t failed = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (fz_stat_info(ctx, paths[i], &infos[i], mask))
+			failed++;
+	}
+	return failed;
+#else
+	(void)ctx;
+
+	if (n < min_paths_for_batching)
+		return stat_range(paths, 0, n, infos, mask);
+
+#if PATHUTILS_HAVE_IO_URING
+	if (!io_uring_unavailable.load(std::memory_order_relaxed)) {
+		stat_ring ring;
+		if (ring.setup((unsigned int)std::min<size_t>(n, max_ring_entries))) {
+			ptrdiff_t failed = ring.run(paths, n, infos, mask);
+			if (failed >= 0)
+				return (size_t)failed;
+			// the ring broke down halfway: redo the lot the ordinary way.
+		}
+		else {
+			io_uring_unavailable.store(true, std::memory_order_relaxed);
+		}
+	}
+#endif
+
+	return stat_with_pool(paths, n, infos, mask);
+#endif
+}
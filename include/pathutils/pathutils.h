@@ -1,4 +1,9 @@
 
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
 #ifdef  __cplusplus
 extern "C" {
 #endif
@@ -16,6 +21,174 @@ int process_path_as_stdio(const char *path, FILE **stdio_handle);
 
 
 
+/* byte classification table shared by all the sanitizers; see byte-classes.cpp */
+
+#define PATHUTILS_BYTECLASS_CONTROL       (1U<<0)   /* ASCII control codes 0x00..0x1F */
+#define PATHUTILS_BYTECLASS_DEL           (1U<<1)   /* 0x7F */
+#define PATHUTILS_BYTECLASS_SPACE         (1U<<2)   /* ' ' */
+#define PATHUTILS_BYTECLASS_DIGIT         (1U<<3)   /* 0-9 */
+#define PATHUTILS_BYTECLASS_UPPER         (1U<<4)   /* A-Z */
+#define PATHUTILS_BYTECLASS_LOWER         (1U<<5)   /* a-z */
+#define PATHUTILS_BYTECLASS_HIGH          (1U<<6)   /* 0x80..0xFF: UTF8 lead/continuation bytes */
+#define PATHUTILS_BYTECLASS_C1_CONTROL    (1U<<7)   /* 0x80..0x9F: the C1 control codes when the text is taken as Latin-1 */
+#define PATHUTILS_BYTECLASS_PATHSEP       (1U<<8)   /* '/' and '\\' */
+#define PATHUTILS_BYTECLASS_DOT           (1U<<9)   /* '.' */
+#define PATHUTILS_BYTECLASS_COLON         (1U<<10)  /* ':' */
+#define PATHUTILS_BYTECLASS_BRACE_OPEN    (1U<<11)  /* "{[<" */
+#define PATHUTILS_BYTECLASS_BRACE_CLOSE   (1U<<12)  /* "}]>" */
+#define PATHUTILS_BYTECLASS_PLAIN         (1U<<13)  /* [A-Za-z0-9_()]: passed as-is by every sanitizer */
+
+/* the banned character sets of the individual sanitizers */
+#define PATHUTILS_BYTECLASS_FZ_BANNED     (1U<<16)  /* fz_sanitize_path: "`\"*@=|;?:" */
+#define PATHUTILS_BYTECLASS_CURL_BANNED   (1U<<17)  /* curl_sanitize_file_name: "|<>\"&'~`?*$^;#%" */
+#define PATHUTILS_BYTECLASS_LEPT_BANNED   (1U<<18)  /* leptDebugGenFilepath: "$~%^&*?|;:'\"<>`" */
+#define PATHUTILS_BYTECLASS_CROW_BANNED   (1U<<19)  /* crow::utility::sanitize_filename: "?<>:*|\"" */
+
+#define PATHUTILS_BYTECLASS_ALNUM         (PATHUTILS_BYTECLASS_DIGIT | PATHUTILS_BYTECLASS_UPPER | PATHUTILS_BYTECLASS_LOWER)
+
+/* sanitizer profiles: the bytes each sanitizer replaces by '_' outright */
+#define PATHUTILS_BYTEPROFILE_FZ          (PATHUTILS_BYTECLASS_CONTROL | PATHUTILS_BYTECLASS_DEL | PATHUTILS_BYTECLASS_FZ_BANNED)
+#define PATHUTILS_BYTEPROFILE_CURL        (PATHUTILS_BYTECLASS_CONTROL | PATHUTILS_BYTECLASS_DEL | PATHUTILS_BYTECLASS_CURL_BANNED)
+#define PATHUTILS_BYTEPROFILE_LEPT        (PATHUTILS_BYTECLASS_CONTROL | PATHUTILS_BYTECLASS_SPACE | PATHUTILS_BYTECLASS_LEPT_BANNED)
+#define PATHUTILS_BYTEPROFILE_CROW        (PATHUTILS_BYTECLASS_CONTROL | PATHUTILS_BYTECLASS_C1_CONTROL | PATHUTILS_BYTECLASS_CROW_BANNED)
+
+typedef unsigned int pathutils_byteclass_t;
+
+extern const pathutils_byteclass_t pathutils_byteclass_table[256];
+
+/* Return non-zero when byte `c` is a member of any of the classes in `mask`. */
+#define pathutils_byte_is(c, mask)        ((pathutils_byteclass_table[(unsigned char)(c)] & (mask)) != 0)
+
+
+
+/* reserved MSDOS/Windows device names, shared by all the sanitizers; see dos-devices.cpp */
+
+typedef enum {
+	PATHUTILS_DOS_DEVICE_NONE = 0,
+	PATHUTILS_DOS_DEVICE_CON,
+	PATHUTILS_DOS_DEVICE_PRN,
+	PATHUTILS_DOS_DEVICE_AUX,
+	PATHUTILS_DOS_DEVICE_NUL,
+	PATHUTILS_DOS_DEVICE_CLOCK,         /* CLOCK$ */
+	PATHUTILS_DOS_DEVICE_COM,           /* COM0..COM9 */
+	PATHUTILS_DOS_DEVICE_LPT,           /* LPT0..LPT9 */
+} pathutils_dos_device;
+
+/* Match a reserved device name at the start of the `len` bytes at `name`, ignoring case. On a match, `*match_len` is set to
+   the length of the device name; what may follow it (e.g. an extension or a colon) is for the caller to decide. */
+pathutils_dos_device pathutils_match_dos_device(const char *name, size_t len, size_t *match_len);
+
+/* Return non-zero when the path segment of `len` bytes at `segment` is one of the reserved UNIX, Mac/OSX or OneDrive
+   file/directory names, e.g. `stdout.txt` or `.DS_Store`; see reserved-names.cpp. Device names are not included: see
+   pathutils_match_dos_device(). */
+int pathutils_match_reserved_name(const char *segment, size_t len);
+
+
+
+/* opt-in cache of the directories known to exist, which lets fz_mkdir_for_file() and fz_mkdirp_utf8() skip the mkdir() calls
+   for directories they have already created or observed; see known-dirs.cpp. All functions are safe to call from multiple threads,
+   except pathutils_known_dirs_destroy(), which requires the cache to be no longer installed or in use. */
+
+typedef struct pathutils_known_dirs pathutils_known_dirs;
+
+/* Return a cache which remembers up to about `capacity` directories, or NULL when out of memory. */
+pathutils_known_dirs *pathutils_known_dirs_create(size_t capacity);
+void pathutils_known_dirs_destroy(pathutils_known_dirs *cache);
+
+/* Install `cache` for use by fz_mkdir_for_file() and fz_mkdirp_utf8(); NULL disables the cache (the default). */
+void pathutils_set_known_dirs(pathutils_known_dirs *cache);
+pathutils_known_dirs *pathutils_get_known_dirs(void);
+
+/* Directories are identified by their path of `len` bytes at `dir`; duplicate and trailing separators are ignored.
+   Only absolute paths are cached: for a relative path, contains() always reports 0 and insert() does nothing. */
+int pathutils_known_dirs_contains(const pathutils_known_dirs *cache, const char *dir, size_t len);
+void pathutils_known_dirs_insert(pathutils_known_dirs *cache, const char *dir, size_t len);
+
+/* Invalidation: callers which remove a directory must forget it; when removing an entire tree, clear the cache. */
+void pathutils_known_dirs_forget(pathutils_known_dirs *cache, const char *dir, size_t len);
+void pathutils_known_dirs_clear(pathutils_known_dirs *cache);
+
+
+
+/* fz_stat_info(): everything fz_stat_ctime(), fz_stat_mtime(), fz_stat_atime(), fz_stat_size(), fz_path_is_regular_file()
+   and fz_path_is_directory() report, from a single stat */
+
+/* which fields to fetch: where the OS supports it (Linux statx()), the others are not even looked up */
+#define FZ_STAT_TYPE    (1U<<0)     /* is_regular_file, is_directory: always fetched */
+#define FZ_STAT_SIZE    (1U<<1)
+#define FZ_STAT_ATIME   (1U<<2)
+#define FZ_STAT_MTIME   (1U<<3)
+#define FZ_STAT_CTIME   (1U<<4)
+#define FZ_STAT_ALL     (FZ_STAT_TYPE | FZ_STAT_SIZE | FZ_STAT_ATIME | FZ_STAT_MTIME | FZ_STAT_CTIME)
+
+typedef struct fz_file_info {
+	unsigned int valid;                 /* the FZ_STAT_* fields which have been filled in; the others are zero */
+	int is_regular_file;
+	int is_directory;
+	int64_t size;                       /* 0 for anything but a regular file */
+	int64_t atime;                      /* seconds since the epoch */
+	int64_t mtime;
+	int64_t ctime;
+	int error;                          /* the errno when the file could not be stat-ed, otherwise 0 */
+} fz_file_info;
+
+struct fz_context;
+
+/* Fill `info` with the `mask` fields (FZ_STAT_*; 0 means FZ_STAT_ALL) of the file at `path`. Return 0 on success, -1 on error. */
+int fz_stat_info(struct fz_context *ctx, const char *path, fz_file_info *info, unsigned int mask);
+
+/* As fz_stat_info(), for all `n` paths at once: `infos[i]` is filled for `paths[i]`. Where possible, the stats are run
+   in parallel: through io_uring on Linux, or else by a pool of worker threads; see file-stat.cpp. Failures are reported
+   per path only, through `infos[i].error`, not through `ctx`. Return the number of paths which could not be stat-ed. */
+size_t fz_stat_many(struct fz_context *ctx, const char *const *paths, size_t n, fz_file_info *infos, unsigned int mask);
+
+#if !defined(_WIN32)
+/* As fz_stat_info(), but without a context: errors are reported through errno and `info->error` only, so this one can
+   be used from any thread. */
+int pathutils_stat_info(const char *path, fz_file_info *info, unsigned int mask);
+/* The same, for a `path` relative to the open directory `dirfd` (or AT_FDCWD), as fstatat() does. */
+int pathutils_stat_info_at(int dirfd, const char *path, fz_file_info *info, unsigned int mask);
+#endif
+
+
+
+/* no-clobber output files: unique names for duplicates, without trying every numbered name in turn; see unique-names.cpp */
+
+/* Exclusively create (open() `flags` | O_CREAT | O_EXCL, with `mode`) the file `path` or, when that one is taken, the first
+   free `<stem><infix>.<NN><ext>`, where `<stem>` is the first `ext_pos` bytes of `path` and `<ext>` the rest. The name of
+   the created file is written to `name_buf`, which must be able to hold `path`, `infix` and 11 more bytes. Return the file
+   descriptor, or -1 on error, with errno EEXIST when all numbered names are taken. Safe to call from multiple threads. */
+int pathutils_open_unique_file(const char *path, size_t ext_pos, const char *infix, int flags, int mode, char *name_buf, size_t name_bufsize);
+
+/* Forget the next free number remembered for every name, e.g. after cleaning out the directories written to. */
+void pathutils_unique_names_clear(void);
+
+
+
+/* fz_sanitize_path_ex() custom replacements, compiled once from its `set` and `replace_single` arguments */
+
+/* what the `_H%08X_` hash of a renamed (reserved or overlong) path segment is calculated over:
+   - FULL_PATH, the default: the path as cleaned up to and including the first renamed segment, plus the untouched rest of the path.
+     That is the original path as long as nothing had to be replaced before that segment; older releases always hashed the original path.
+   - SEGMENT_PREFIX: the path as cleaned up to and including each renamed segment, so its name does not depend on what follows. */
+#define PATHUTILS_SANITIZE_HASH_FULL_PATH       0
+#define PATHUTILS_SANITIZE_HASH_SEGMENT_PREFIX  1
+
+typedef struct pathutils_sanitize_policy {
+	char replacement[256];              /* non-zero: the replacement character for this byte */
+	char printf_format_replacement;     /* non-zero when `set` includes 'f': the replacement for an entire printf-style format spec */
+	int has_plain_bytes;                /* `set` includes bytes of the PATHUTILS_BYTECLASS_PLAIN class */
+	int has_high_bytes;                 /* `set` includes bytes of the PATHUTILS_BYTECLASS_HIGH class */
+	int hash_mode;                      /* PATHUTILS_SANITIZE_HASH_* */
+} pathutils_sanitize_policy;
+
+/* fz_sanitize_path_ex() always uses PATHUTILS_SANITIZE_HASH_FULL_PATH: compile a policy to select another `hash_mode`. */
+void pathutils_compile_sanitize_policy(pathutils_sanitize_policy *policy, const char *set, const char *replace_single, int hash_mode);
+
+int fz_sanitize_path_with_policy(char *path, const pathutils_sanitize_policy *policy, size_t start_at_offset, size_t maximum_path_length);
+
+
+
 /* curl_sanitize_file_name flags */
 
 #define CURL_SANITIZE_ALLOW_COLONS              (1<<0)  /* Allow colons */
@@ -30,11 +203,16 @@ typedef enum {
 	CURL_SANITIZE_ERR_INVALID_PATH,     /* 1 - the path is invalid */
 	CURL_SANITIZE_ERR_BAD_ARGUMENT,     /* 2 - bad function parameter */
 	CURL_SANITIZE_ERR_OUT_OF_MEMORY,    /* 3 - out of memory */
+	CURL_SANITIZE_ERR_BUFFER_TOO_SMALL, /* 4 - the caller-supplied output buffer is too small */
 	CURL_SANITIZE_ERR_LAST              /* never use! */
 } CurlSanitizeCode;
 
 CurlSanitizeCode curl_sanitize_file_name(char **const sanitized, const char *file_name, int flags);
 
+/* as curl_sanitize_file_name(), but sanitizes the first 'file_name_len' bytes of 'file_name' (up to the
+   first NUL) into the caller-supplied buffer 'sanitized' of 'sanitized_size' bytes, without allocating. */
+CurlSanitizeCode curl_sanitize_file_name_buf(char *sanitized, size_t sanitized_size, const char *file_name, size_t file_name_len, int flags);
+
 
 
 /* sanitize a local file for writing, return TRUE on success */
@@ -46,7 +224,7 @@ bool tool_create_output_file(struct OutStruct *outs,
 
 
 
-bool sanitize_with_extreme_prejudice; /* Sanitize URLs with extreme prejudice, i.e.
+extern bool sanitize_with_extreme_prejudice; /* Sanitize URLs with extreme prejudice, i.e.
 										accept some pretty shoddy input and make
 										the best of it.
 										Output filenames are also sanitized with extreme
@@ -0,0 +1,151 @@
+
+#pragma once
+
+// The C++ API of libpathutils: see pathutils.h for the C API.
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include <stdio.h>
+
+#include "pathutils.h"
+
+struct fz_context;
+
+namespace pathutils {
+
+	// Return a FILE* when the given path is a stio/null path, otherwise return the path string as is.
+	std::variant<FILE *, const char *> is_stdio_path(const char *path, bool dash_as_stdout = true, bool con_as_stderr = true);
+
+	// Return true when the path is one of the antiquated MSDOS device names (see pathutils_match_dos_device()), optionally followed by a ':'.
+	bool name_is_antiquated_dos_device(const char *path, size_t len);
+	bool name_is_antiquated_dos_device(const char *path);
+
+	// Length-aware overloads of the path sanitizers, which accept paths as views into the caller's own buffers
+	// and write their output into a caller-supplied span or a reusable std::string: these copy the input exactly
+	// once, straight into the output buffer, and never allocate when the output fits.
+	//
+	// As the underlying sanitizers work on NUL-terminated strings, an embedded NUL terminates the path.
+	//
+	// The span overloads return a view of the result within `dst`, or std::nullopt when `dst` cannot
+	// hold the input plus a NUL sentinel. The std::string overloads reuse the capacity of `dst`.
+
+	// See fz_sanitize_path_with_policy(); `policy` may be NULL, in which case no custom replacements are done.
+	std::optional<std::string_view> sanitize_path(std::string_view path, std::span<char> dst, const pathutils_sanitize_policy *policy = nullptr);
+	void sanitize_path(std::string_view path, std::string &dst, const pathutils_sanitize_policy *policy = nullptr);
+
+	// The output of sanitize_batch(): all sanitized paths, stored back to back in a single buffer.
+	//
+	// Path `i` occupies `data[offsets[i] .. offsets[i + 1] - 1)` and is followed by a NUL sentinel,
+	// so it can be passed to the C API as-is via c_str(). The arena is reusable: a next batch
+	// recycles the capacity of both vectors.
+	struct output_arena
+	{
+		std::vector<char> data;
+		std::vector<size_t> offsets;
+
+		size_t size() const
+		{
+			return offsets.empty() ? 0 : offsets.size() - 1;
+		}
+
+		std::string_view operator[](size_t i) const
+		{
+			return std::string_view(data.data() + offsets[i], offsets[i + 1] - offsets[i] - 1);
+		}
+
+		const char *c_str(size_t i) const
+		{
+			return data.data() + offsets[i];
+		}
+
+		void clear()
+		{
+			data.clear();
+			offsets.clear();
+		}
+	};
+
+	// Sanitize a batch of paths (see fz_sanitize_path_with_policy()) into `dst`, replacing its previous content.
+	//
+	// The batch is partitioned into contiguous slices, which are sanitized in parallel by up to `thread_count`
+	// worker threads; 0 picks one per hardware thread. Small batches are processed on the calling thread.
+	void sanitize_batch(std::span<const std::string_view> paths, output_arena &dst, const pathutils_sanitize_policy *policy = nullptr, unsigned int thread_count = 0);
+
+	// See fz_normalize_path(): throws a mupdf exception when the path cannot be normalized, e.g. `C:/../b0rk`.
+	std::optional<std::string_view> normalize_path(fz_context *ctx, std::string_view path, std::span<char> dst);
+	void normalize_path(fz_context *ctx, std::string_view path, std::string &dst);
+
+#if !defined(_WIN32)
+	// A directory which is opened once, after which the files and directories in it are accessed by relative name,
+	// through openat(), mkdirat(), unlinkat() and fstatat(): the kernel then only resolves the relative name, instead of
+	// walking the full path for every fz_fopen_utf8(), fz_mkdir(), fz_remove_utf8() or fz_stat_info() call. As the
+	// directory itself is pinned by the handle, renaming or replacing its path (e.g. by a symlink) between sanitizing
+	// a file name and creating the file cannot redirect the file elsewhere.
+	//
+	// `name` may be a relative path, e.g. `sub/dir/file.txt`; absolute paths ignore the handle, as with openat().
+	//
+	// Errors are reported the C way: a failing call returns -1, NULL or an unopened handle, with errno set.
+	class dir_handle
+	{
+	public:
+		dir_handle() = default;
+		~dir_handle();
+
+		dir_handle(dir_handle &&other) noexcept;
+		dir_handle &operator=(dir_handle &&other) noexcept;
+		dir_handle(const dir_handle &) = delete;
+		dir_handle &operator=(const dir_handle &) = delete;
+
+		// Open the directory at `path`, relative to the current directory. Check is_open() for success.
+		static dir_handle open(const char *path);
+
+		bool is_open() const
+		{
+			return fd_ >= 0;
+		}
+
+		int fd() const
+		{
+			return fd_;
+		}
+
+		void close();
+
+		// Open the subdirectory `name`; with `create`, it (but not its parents) is created first when it does not exist yet.
+		dir_handle subdir(const char *name, bool create = false) const;
+
+		// openat(): return a file descriptor, or -1 on error.
+		int open_file(const char *name, int flags, int mode = 0666) const;
+		// As fopen(), including its "x" (exclusive create) and "e" (close-on-exec) mode flags.
+		FILE *fopen(const char *name, const char *mode) const;
+
+		// mkdirat(), unlinkat(): return 0 on success, -1 on error. As remove(), remove() deletes files and empty directories alike.
+		int mkdir(const char *name, int mode = 0777) const;
+		int remove(const char *name) const;
+
+		// See fz_stat_info(): return 0 on success, -1 on error.
+		int stat(const char *name, fz_file_info *info, unsigned int mask = FZ_STAT_ALL) const;
+
+	private:
+		explicit dir_handle(int fd)
+			: fd_(fd)
+		{
+		}
+
+		int fd_ = -1;
+	};
+#endif
+
+#if defined(_WIN32) || defined(MSDOS)
+	// See curl_sanitize_file_name_buf(): on success `sanitized` is set to a view of the result within `dst`.
+	// A `dst` of `file_name.size() + 3` bytes is always large enough, except on MS-DOS.
+	CurlSanitizeCode curl_sanitize_file_name(std::string_view file_name, std::span<char> dst, std::string_view &sanitized, int flags);
+	CurlSanitizeCode curl_sanitize_file_name(std::string_view file_name, std::string &dst, int flags);
+#endif
+
+}
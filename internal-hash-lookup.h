@@ -1,7 +1,166 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdexcept>
+
 namespace pathutils {
 
+	// Compile-time generated perfect hashing for small, fixed keyword tables, such as the paths recognized by
+	// is_stdio_path() and the reserved names refused by the sanitizers.
+	//
+	// The keyword table is a plain constexpr array; perfect_hash_map searches, at compile time, for a hash seed
+	// which gives every keyword a slot of its own, so a lookup costs one pass over the key for the hash plus
+	// at most one confirming compare: no allocations, no external generator tool. Keywords match ASCII
+	// case-insensitively.
+	//
+	// Usage:
+	//
+	//     static constexpr hash_keyword<int> keywords[] = { { "stdout", 1 }, { "stderr", 2 } };
+	//     static constexpr perfect_hash_map<int, std::size(keywords)> map(keywords);
+	//
+	//     const int *v = map.find(s, len);
+
+	template <typename Value>
+	struct hash_keyword
+	{
+		const char *name;
+		Value value;
+	};
+
+	namespace detail {
+
+		constexpr unsigned char hash_fold(char c)
+		{
+			return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : (unsigned char)c;
+		}
+
+		constexpr size_t hash_strlen(const char *s)
+		{
+			size_t len = 0;
+			while (s[len])
+				len++;
+			return len;
+		}
+
+		// FNV-1a over the folded key, followed by a 32-bit avalanche so the top bits can be used as the slot index.
+		constexpr uint32_t hash_folded(const char *s, size_t len, uint32_t seed)
+		{
+			uint32_t h = 2166136261U ^ seed;
+			for (size_t i = 0; i < len; i++) {
+				h ^= hash_fold(s[i]);
+				h *= 16777619U;
+			}
+			h ^= h >> 16;
+			h *= 0x7FEB352DU;
+			h ^= h >> 15;
+			h *= 0x846CA68BU;
+			h ^= h >> 16;
+			return h;
+		}
+
+		constexpr bool hash_equal_folded(const char *a, const char *b, size_t len)
+		{
+			for (size_t i = 0; i < len; i++) {
+				if (hash_fold(a[i]) != hash_fold(b[i]))
+					return false;
+			}
+			return true;
+		}
+
+		// smallest power of two at least four times the number of keywords: sparse enough for a seed to be found quickly.
+		constexpr unsigned int perfect_hash_bits(size_t n)
+		{
+			unsigned int bits = 1;
+			while (((size_t)1 << bits) < n * 4)
+				bits++;
+			return bits;
+		}
+
+	}
+
+	template <typename Value, size_t N, unsigned int Bits = detail::perfect_hash_bits(N)>
+	class perfect_hash_map
+	{
+		static_assert(N > 0, "empty keyword table");
+		static_assert(Bits > 0 && Bits < 16, "keyword table too large");
+
+	public:
+		static constexpr size_t table_size = (size_t)1 << Bits;
+
+		constexpr explicit perfect_hash_map(const hash_keyword<Value> (&keywords)[N])
+		{
+			for (size_t i = 0; i < N; i++) {
+				size_t len = detail::hash_strlen(keywords[i].name);
+				if (len == 0)
+					throw std::logic_error("perfect_hash_map: empty keyword");
+				if (len > 255)
+					throw std::logic_error("perfect_hash_map: keyword too long");
+				if (len < min_length_)
+					min_length_ = len;
+				if (len > max_length_)
+					max_length_ = len;
+				for (size_t j = 0; j < i; j++) {
+					if (detail::hash_strlen(keywords[j].name) == len && detail::hash_equal_folded(keywords[i].name, keywords[j].name, len))
+						throw std::logic_error("perfect_hash_map: duplicate keyword");
+				}
+			}
+
+			for (uint32_t seed = 0; seed < 100000; seed++) {
+				bool collision = false;
+				for (size_t s = 0; s < table_size; s++)
+					slots_[s] = slot{};
+				for (size_t i = 0; i < N && !collision; i++) {
+					size_t len = detail::hash_strlen(keywords[i].name);
+					slot &s = slots_[detail::hash_folded(keywords[i].name, len, seed) >> (32 - Bits)];
+					if (s.name)
+						collision = true;
+					else
+						s = slot{ keywords[i].name, (unsigned char)len, keywords[i].value };
+				}
+				if (!collision) {
+					seed_ = seed;
+					return;
+				}
+			}
+			throw std::logic_error("perfect_hash_map: no perfect hash seed found");
+		}
+
+		// Return the value of the keyword matching the `len` bytes at `s` (ignoring case), or NULL when there is none.
+		constexpr const Value *find(const char *s, size_t len) const
+		{
+			if (len < min_length_ || len > max_length_)
+				return nullptr;
+			const slot &e = slots_[detail::hash_folded(s, len, seed_) >> (32 - Bits)];
+			if (e.len != len || !detail::hash_equal_folded(s, e.name, len))
+				return nullptr;
+			return &e.value;
+		}
+
+		constexpr size_t min_length() const
+		{
+			return min_length_;
+		}
+
+		constexpr size_t max_length() const
+		{
+			return max_length_;
+		}
+
+	private:
+		struct slot
+		{
+			const char *name = nullptr;
+			unsigned char len = 0;
+			Value value{};
+		};
+
+		slot slots_[table_size]{};
+		uint32_t seed_ = 0;
+		size_t min_length_ = SIZE_MAX;
+		size_t max_length_ = 0;
+	};
 
 }
@@ -2,76 +2,92 @@
 #include "pathutils.hpp"
 #include "pathutils.h"
 
+#include <algorithm>
+#include <iterator>
 #include <variant>
 #include <stdio.h>
+#include <string.h>
+
+#include "internal-hash-lookup.h"
 
 // static STRING_VAR(debug_file, "", "File to send the application diagnostic messages to. Accepts '-' or '1' for stdout, '+' or '2' for stderr, and also recognizes these on *all* platforms: NUL:, /dev/null, /dev/stdout, /dev/stderr, 1, 2");
 
 // CON:, NUL:, AUX:, COM1:, COM2:, COM3:, COM4:, PRN:, LPT1:, LPT2:, LPT3:,
 // 
-// CON, PRN, AUX, NUL 
-// COM1, COM2, COM3, COM4, COM5, COM6, COM7, COM8, COM9
-// LPT1, LPT2, LPT3, LPT4, LPT5, LPT6, LPT7, LPT8, LPT9
+// CON, PRN, AUX, NUL, CLOCK$
+// COM0, COM1, COM2, COM3, COM4, COM5, COM6, COM7, COM8, COM9
+// LPT0, LPT1, LPT2, LPT3, LPT4, LPT5, LPT6, LPT7, LPT8, LPT9
 
 namespace pathutils {
 
-	static inline bool streq(const char *s1, const char *s2)
+	// The paths is_stdio_path() recognizes. Matching ignores case.
+	enum system_channel
 	{
-		return strcmp(s1, s2) == 0;
-	}
+		SYSTEM_CHANNEL_STDOUT = 1,
+		SYSTEM_CHANNEL_STDERR,
+		SYSTEM_CHANNEL_NULL,
+		SYSTEM_CHANNEL_DASH,          // stdout, or stderr when is_stdio_path() is told so
+		SYSTEM_CHANNEL_CONSOLE,       // stderr, or stdout when is_stdio_path() is told so
+	};
 
-	static inline bool strieq(const char *s1, const char *s2)
-	{
-		return stricmp(s1, s2) == 0;
-	}
+	static constexpr hash_keyword<system_channel> system_channel_keywords[] = {
+		{ "1", SYSTEM_CHANNEL_STDOUT },
+		{ "2", SYSTEM_CHANNEL_STDERR },
+		{ "-", SYSTEM_CHANNEL_DASH },
+		{ "+", SYSTEM_CHANNEL_STDERR },
+		{ "stdout", SYSTEM_CHANNEL_STDOUT },
+		{ "stderr", SYSTEM_CHANNEL_STDERR },
+		{ "/dev/stdout", SYSTEM_CHANNEL_STDOUT },
+		{ "/dev/stderr", SYSTEM_CHANNEL_STDERR },
+		{ "/dev/null", SYSTEM_CHANNEL_NULL },
+		{ "nul", SYSTEM_CHANNEL_NULL },
+	};
 
-	static inline bool strnieq(const char *s1, const char *s2, size_t len)
+	static constexpr perfect_hash_map<system_channel, std::size(system_channel_keywords)> system_channels(system_channel_keywords);
+
+	// One hash, at most one (case-insensitive) confirming compare. The MSDOS devices, each optionally followed by
+	// a colon, are left to pathutils_match_dos_device(), which defines that set for all of us.
+	static inline int lookup_system_channel(const char *path)
 	{
-		return strnicmp(s1, s2, len) == 0;
+		// the longest name we can match is either a channel or "CLOCK$:".
+		size_t len = strnlen(path, std::max(system_channels.max_length(), sizeof("CLOCK$:") - 1) + 1);
+		const system_channel *channel = system_channels.find(path, len);
+		if (channel)
+			return *channel;
+
+		size_t n;
+		pathutils_dos_device device = pathutils_match_dos_device(path, len, &n);
+		if (device == PATHUTILS_DOS_DEVICE_NONE || !(len == n || (len == n + 1 && path[n] == ':')))
+			return 0;
+		return (device == PATHUTILS_DOS_DEVICE_NUL) ? SYSTEM_CHANNEL_NULL : SYSTEM_CHANNEL_CONSOLE;
 	}
 
 	std::variant<FILE *, const char *> is_stdio_path(const char *path, bool dash_as_stdout, bool con_as_stderr)
 	{
-		if (strieq(path, "/dev/stdout") || strieq(path, "stdout") || strieq(path, "1")) {
+		switch (lookup_system_channel(path)) {
+		case SYSTEM_CHANNEL_STDOUT:
 			return stdout;
 			//_canonical_filepath = "/dev/stdout";
-		}
-		if (strieq(path, "/dev/stderr") || strieq(path, "stderr") || strieq(path, "+") || strieq(path, "2")) {
+
+		case SYSTEM_CHANNEL_STDERR:
 			return stderr;
 			//_canonical_filepath = "/dev/stderr";
-		}
-		if (strieq(path, "-")) {
+
+		case SYSTEM_CHANNEL_DASH:
 			return (dash_as_stdout ? stdout : stderr);
 			//_canonical_filepath = "/dev/stdout";
-		}
-		if (strlen(path) <= 5) {
-			if (strieq(path, "con") || strieq(path, "con:")) {
-				return (con_as_stderr ? stderr : stdout);
-				//_canonical_filepath = "/dev/stderr";
-			}
-			if (strieq(path, "aux") || strieq(path, "aux:")) {
-				return (con_as_stderr ? stderr : stdout);
-				//_canonical_filepath = "/dev/stderr";
-			}
-			if (strieq(path, "prn") || strieq(path, "prn:")) {
-				return (con_as_stderr ? stderr : stdout);
-				//_canonical_filepath = "/dev/stderr";
-			}
-			if (strnieq(path, "com", 3) || strnieq(path, "lpt", 3)) {
-				unsigned int offset = 3;
-				if (strchr("123456789", path[3]))
-					offset++;
-				if (path[offset] == 0 || streq(path + offset, ":")) {
-					return (con_as_stderr ? stderr : stdout);
-					//_canonical_filepath = "/dev/stderr";
-				}
-			}
-		}
-		if (strieq(path, "/dev/null") || strieq(path, "nul") || strieq(path, "nul:")) {
+
+		case SYSTEM_CHANNEL_CONSOLE:
+			return (con_as_stderr ? stderr : stdout);
+			//_canonical_filepath = "/dev/stderr";
+
+		case SYSTEM_CHANNEL_NULL:
 			return (FILE *)nullptr;
 			//_canonical_filepath = "/dev/null";
+
+		default:
+			return path;
 		}
-		return path;
 	}
 
 
@@ -0,0 +1,202 @@
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+
+#include "pathutils.h"
+
+// The opt-in 'known directories' cache of fz_mkdir_for_file() and fz_mkdirp_utf8().
+//
+// When many files are written into the same directory tree, creating the directory (chain) for each of them is mostly
+// wasted effort: the directory was already created or observed for the previous file. Once a cache has been installed
+// with pathutils_set_known_dirs(), the mkdirp code asks it first and skips the mkdir() syscalls for every directory
+// it already knows about.
+//
+// The cache is a lock-free set of 64-bit fingerprints of the normalized directory paths, split into shards of a few
+// cache lines each, so threads writing into different directories hardly ever touch the same cache line. Each slot is
+// a single atomic word: an insert is one compare-and-swap into an empty slot within a short probe window, and when
+// that window is full the directory is simply not remembered. Fingerprints are the only thing stored: two directories
+// with the same 64-bit fingerprint are taken as the same one, which is deemed acceptable for a cache of this size.
+//
+// Relative paths are never cached, so a chdir() cannot make an entry refer to another directory; and callers only
+// insert paths they know to be directories, not merely names for which mkdir() reported EEXIST.
+//
+// The cache does not notice directories being removed: callers which delete directories (trees) must tell it, using
+// pathutils_known_dirs_forget() or pathutils_known_dirs_clear().
+
+namespace pathutils {
+
+	namespace {
+
+		constexpr uint64_t EMPTY_SLOT = 0;
+		constexpr uint64_t FORGOTTEN_SLOT = 1;      // keeps probe windows intact; may be reused by an insert
+
+		constexpr size_t SHARD_BITS = 6;
+		constexpr size_t SHARD_COUNT = (size_t)1 << SHARD_BITS;
+		constexpr size_t PROBE_WINDOW = 16;
+
+		inline bool is_separator(char c)
+		{
+#if defined(_WIN32)
+			return c == '/' || c == '\\';
+#else
+			return c == '/';
+#endif
+		}
+
+		// Only absolute paths are cached: a relative path means another directory after a chdir(). On Windows, that
+		// means a drive letter plus root (`C:/`) or an UNC path (`//server/`); a bare `/dir` depends on the current drive.
+		bool is_absolute(const char *dir, size_t len)
+		{
+#if defined(_WIN32)
+			if (len >= 3 && dir[1] == ':' && is_separator(dir[2]))
+				return true;
+			return len >= 2 && is_separator(dir[0]) && is_separator(dir[1]);
+#else
+			return len >= 1 && dir[0] == '/';
+#endif
+		}
+
+		// FNV-1a over the normalized path: separator runs count as a single '/', trailing separators are ignored,
+		// and on Windows the (ASCII) case is ignored as well.
+		uint64_t fingerprint(const char *dir, size_t len)
+		{
+			while (len > 1 && is_separator(dir[len - 1]))
+				len--;
+
+			uint64_t h = 14695981039346656037ULL;
+			for (size_t i = 0; i < len; i++) {
+				unsigned char c = (unsigned char)dir[i];
+				if (is_separator(c)) {
+					if (i > 0 && is_separator(dir[i - 1]))
+						continue;
+					c = '/';
+				}
+#if defined(_WIN32)
+				else if (c >= 'A' && c <= 'Z') {
+					c += 'a' - 'A';
+				}
+#endif
+				h ^= c;
+				h *= 1099511628211ULL;
+			}
+			h ^= h >> 33;
+			h *= 0xFF51AFD7ED558CCDULL;
+			h ^= h >> 33;
+
+			if (h <= FORGOTTEN_SLOT)
+				h += 2;
+			return h;
+		}
+
+	}
+
+}
+
+using namespace pathutils;
+
+struct pathutils_known_dirs
+{
+	size_t shard_mask;                              // slots per shard - 1
+	std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+	std::atomic<uint64_t> *shard_for(uint64_t key) const
+	{
+		return &slots[(key >> (64 - SHARD_BITS)) * (shard_mask + 1)];
+	}
+};
+
+static std::atomic<pathutils_known_dirs *> installed_known_dirs{nullptr};
+
+extern "C" pathutils_known_dirs *pathutils_known_dirs_create(size_t capacity)
+{
+	size_t shard_size = PROBE_WINDOW;
+	while (shard_size * SHARD_COUNT < capacity)
+		shard_size <<= 1;
+
+	pathutils_known_dirs *cache = new (std::nothrow) pathutils_known_dirs;
+	if (!cache)
+		return nullptr;
+	cache->shard_mask = shard_size - 1;
+	cache->slots.reset(new (std::nothrow) std::atomic<uint64_t>[shard_size * SHARD_COUNT]);
+	if (!cache->slots) {
+		delete cache;
+		return nullptr;
+	}
+	pathutils_known_dirs_clear(cache);
+	return cache;
+}
+
+extern "C" void pathutils_known_dirs_destroy(pathutils_known_dirs *cache)
+{
+	delete cache;
+}
+
+extern "C" void pathutils_set_known_dirs(pathutils_known_dirs *cache)
+{
+	installed_known_dirs.store(cache, std::memory_order_release);
+}
+
+extern "C" pathutils_known_dirs *pathutils_get_known_dirs(void)
+{
+	return installed_known_dirs.load(std::memory_order_acquire);
+}
+
+extern "C" int pathutils_known_dirs_contains(const pathutils_known_dirs *cache, const char *dir, size_t len)
+{
+	if (!is_absolute(dir, len))
+		return 0;
+	uint64_t key = fingerprint(dir, len);
+	const std::atomic<uint64_t> *shard = cache->shard_for(key);
+	for (size_t i = 0; i < PROBE_WINDOW; i++) {
+		uint64_t v = shard[(key + i) & cache->shard_mask].load(std::memory_order_acquire);
+		if (v == key)
+			return 1;
+		if (v == EMPTY_SLOT)
+			return 0;
+	}
+	return 0;
+}
+
+extern "C" void pathutils_known_dirs_insert(pathutils_known_dirs *cache, const char *dir, size_t len)
+{
+	if (!is_absolute(dir, len))
+		return;
+	uint64_t key = fingerprint(dir, len);
+	std::atomic<uint64_t> *shard = cache->shard_for(key);
+	for (size_t i = 0; i < PROBE_WINDOW; i++) {
+		std::atomic<uint64_t> &slot = shard[(key + i) & cache->shard_mask];
+		uint64_t v = slot.load(std::memory_order_relaxed);
+		while (v == EMPTY_SLOT || v == FORGOTTEN_SLOT) {
+			if (slot.compare_exchange_weak(v, key, std::memory_order_release, std::memory_order_relaxed))
+				return;
+		}
+		if (v == key)
+			return;
+	}
+	// probe window is full: we don't remember this one.
+}
+
+extern "C" void pathutils_known_dirs_forget(pathutils_known_dirs *cache, const char *dir, size_t len)
+{
+	uint64_t key = fingerprint(dir, len);
+	std::atomic<uint64_t> *shard = cache->shard_for(key);
+	// an insert may have reused a forgotten slot ahead of an older copy, so check the entire window:
+	for (size_t i = 0; i < PROBE_WINDOW; i++) {
+		std::atomic<uint64_t> &slot = shard[(key + i) & cache->shard_mask];
+		uint64_t v = key;
+		slot.compare_exchange_strong(v, FORGOTTEN_SLOT, std::memory_order_release, std::memory_order_relaxed);
+		if (v == EMPTY_SLOT)
+			return;
+	}
+}
+
+extern "C" void pathutils_known_dirs_clear(pathutils_known_dirs *cache)
+{
+	size_t count = (cache->shard_mask + 1) * SHARD_COUNT;
+	for (size_t i = 0; i < count; i++)
+		cache->slots[i].store(EMPTY_SLOT, std::memory_order_release);
+}
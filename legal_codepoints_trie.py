@@ -0,0 +1,78 @@
+#! /usr/bin/env python3
+#
+# Generate legal_codepoints_trie.inc: the set of Unicode codepoints which fz_sanitize_path_ex() accepts
+# in a path, i.e. all Letters (L*) and Numbers (N*), across the entire Unicode range.
+#
+# The set is stored as a two-level trie: the codepoint's high bits index a byte table, which selects
+# one of the unique 256-codepoint bitmap blocks. As blocks are 32 bytes and 32-byte aligned, a lookup
+# costs at most two cache-line loads. Beyond the highest legal codepoint no table is consulted at all.
+#
+# Usage:
+#
+#     python3 legal_codepoints_trie.py > legal_codepoints_trie.inc
+#
+
+import sys
+import unicodedata
+
+BLOCK_SHIFT = 8
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+WORDS_PER_BLOCK = BLOCK_SIZE // 32
+
+
+def is_legal(cp):
+	return unicodedata.category(chr(cp))[0] in 'LN'
+
+
+def main():
+	max_cp = max(cp for cp in range(0x110000) if is_legal(cp))
+	block_count = (max_cp >> BLOCK_SHIFT) + 1
+
+	blocks = []
+	block_ids = {}
+	index = []
+	for b in range(block_count):
+		words = []
+		for w in range(WORDS_PER_BLOCK):
+			word = 0
+			for bit in range(32):
+				cp = (b << BLOCK_SHIFT) + w * 32 + bit
+				if cp <= max_cp and is_legal(cp):
+					word |= 1 << bit
+			words.append(word)
+		words = tuple(words)
+		if words not in block_ids:
+			block_ids[words] = len(blocks)
+			blocks.append(words)
+		index.append(block_ids[words])
+
+	assert len(blocks) <= 256
+
+	out = sys.stdout
+	out.write('// Generated by legal_codepoints_trie.py from the Unicode %s database -- DO NOT EDIT!\n' % unicodedata.unidata_version)
+	out.write('//\n')
+	out.write('// Unicode Letters (L*) and Numbers (N*): %d index entries, %d unique blocks, %d bytes total.\n' % (len(index), len(blocks), len(index) + len(blocks) * WORDS_PER_BLOCK * 4))
+	out.write('\n')
+	out.write('#define LEGAL_CODEPOINTS_MAX            0x%XU\n' % max_cp)
+	out.write('#define LEGAL_CODEPOINTS_BLOCK_SHIFT    %d\n' % BLOCK_SHIFT)
+	out.write('\n')
+	out.write('static const uint8_t legal_codepoints_trie_index[%d] = {\n' % len(index))
+	for i in range(0, len(index), 16):
+		out.write('\t' + ','.join('%d' % v for v in index[i:i + 16]) + ',\n')
+	out.write('};\n')
+	out.write('\n')
+	out.write('#if defined(_MSC_VER)\n')
+	out.write('__declspec(align(32))\n')
+	out.write('#endif\n')
+	out.write('static const uint32_t legal_codepoints_trie_blocks[%d][%d]\n' % (len(blocks), WORDS_PER_BLOCK))
+	out.write('#if !defined(_MSC_VER)\n')
+	out.write('__attribute__((aligned(32)))\n')
+	out.write('#endif\n')
+	out.write('= {\n')
+	for words in blocks:
+		out.write('\t{' + ','.join('0x%08XU' % w for w in words) + '},\n')
+	out.write('};\n')
+
+
+if __name__ == '__main__':
+	main()
@@ -1,3 +1,5 @@
+#include "pathutils.h"
+
 
 
 /*!
@@ -137,10 +139,7 @@ leptDebugGenFilepath(const char* path_fmt_str, ...)
 					p += 1;
 					continue;
 				}
-				else if (c <= ' ') {   // replace spaces and low-ASCII chars
-					p[0] = '_';
-				}
-				else if (strchr("$~%^&*?|;:'\"<>`", c)) {
+				else if (pathutils_byte_is(c, PATHUTILS_BYTEPROFILE_LEPT)) {   // replace spaces, low-ASCII chars and shell-risky chars
 					p[0] = '_';
 				}
 				else if (c == '\\') {
@@ -1 +1,30 @@
 
+#include "pathutils.hpp"
+
+#include "mupdf/fitz.h"
+
+#include <string.h>
+
+namespace pathutils {
+
+	std::optional<std::string_view> normalize_path(fz_context *ctx, std::string_view path, std::span<char> dst)
+	{
+		if (dst.size() < path.size() + 1)
+			return std::nullopt;
+
+		// normalizing never makes a path longer, so we copy the input once, straight into the output buffer, and normalize in place:
+		memmove(dst.data(), path.data(), path.size());
+		dst[path.size()] = 0;
+		fz_normalize_path(ctx, dst.data(), dst.size(), NULL);
+		return std::string_view(dst.data(), strlen(dst.data()));
+	}
+
+	void normalize_path(fz_context *ctx, std::string_view path, std::string &dst)
+	{
+		// assign() reuses the existing capacity of `dst`, so this only allocates when `dst` is too small.
+		dst.assign(path);
+		fz_normalize_path(ctx, dst.data(), dst.size() + 1, NULL);
+		dst.resize(strlen(dst.c_str()));
+	}
+
+}
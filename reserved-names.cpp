@@ -0,0 +1,94 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <iterator>
+
+#include "pathutils.h"
+#include "internal-hash-lookup.h"
+
+// The reserved file/directory names which fz_sanitize_path_ex() refuses to produce.
+//
+// The MSDOS/Windows device names (CON, LPT1, ...) are not in here: those are shared by all the sanitizers,
+// see pathutils_match_dos_device().
+//
+// A path segment is looked up by its 'stem': its first character plus everything up to the first '.' or digit,
+// so `stdout.txt` is looked up as `stdout` and `.DS_Store` as `.DS_Store`. Each name comes with a rule for
+// what may follow the stem in a reserved segment:
+//
+// - RESERVED_BASENAME: nothing, or an extension: `null`, `null.txt`, `null.tar.gz`
+// - RESERVED_PREFIX:   the given `tail`, followed by anything: `desktop.ini`
+
+namespace pathutils {
+
+	namespace {
+
+		enum reserved_name_rule
+		{
+			RESERVED_BASENAME = 1,     // stem, optionally followed by an extension
+			RESERVED_PREFIX,           // stem, followed by `tail`
+		};
+
+		struct reserved_name
+		{
+			reserved_name_rule rule;
+			const char *tail;
+		};
+
+		constexpr hash_keyword<reserved_name> reserved_name_keywords[] = {
+			// UNIX devices and standard channels
+			{ "null", { RESERVED_BASENAME, nullptr } },
+			{ "dev", { RESERVED_BASENAME, nullptr } },
+			{ "stdin", { RESERVED_BASENAME, nullptr } },
+			{ "stdout", { RESERVED_BASENAME, nullptr } },
+			{ "stderr", { RESERVED_BASENAME, nullptr } },
+			// Mac/OSX
+			{ "__macosx", { RESERVED_BASENAME, nullptr } },
+			{ ".ds_store", { RESERVED_BASENAME, nullptr } },
+			// OneDrive / SharePoint
+			{ ".lock", { RESERVED_BASENAME, nullptr } },
+			{ "desktop", { RESERVED_PREFIX, ".ini" } },
+		};
+
+		constexpr perfect_hash_map<reserved_name, std::size(reserved_name_keywords)> reserved_names(reserved_name_keywords);
+
+		inline bool is_digit(char c)
+		{
+			return c >= '0' && c <= '9';
+		}
+
+	}
+
+}
+
+using namespace pathutils;
+
+extern "C" int pathutils_match_reserved_name(const char *segment, size_t len)
+{
+	if (len == 0)
+		return 0;
+
+	size_t stem_len = 1;
+	while (stem_len < len && segment[stem_len] != '.' && !is_digit(segment[stem_len]))
+		stem_len++;
+
+	const reserved_name *r = reserved_names.find(segment, stem_len);
+	if (!r)
+		return 0;
+
+	const char *rest = segment + stem_len;
+	size_t rest_len = len - stem_len;
+	switch (r->rule) {
+	case RESERVED_BASENAME:
+		return rest_len == 0 || rest[0] == '.';
+
+	case RESERVED_PREFIX:
+		{
+			size_t tail_len = strlen(r->tail);
+			return rest_len >= tail_len && detail::hash_equal_folded(rest, r->tail, tail_len);
+		}
+	}
+
+	return 0;
+}
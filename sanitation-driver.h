@@ -0,0 +1,704 @@
+#pragma once
+
+// The sanitation driver: see sanitation-driver.cpp for the design rationale.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <expected>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <concepts>
+#include <vector>
+
+#include "pathutils.hpp"
+#if 0
+#include <exception>
+#include <stdexcept>
+#else
+// objections to exceptions are mostly cf. CppCon/Bloomberg 2024 (IIRC), but his template-exception baseclass "that does it all" is a red herring from my perspective: you *still* get a shitload of exception classes, only now those are generated by the compiler and `using` statements, so it's a non-solution for at least one of his own major complaints.
+// Meanwhile, another convention presentation for embedded use of exceptions showed quite scientifically that using exceptions (iff properly adjusted for embedded use contexts, i.e. ditching stdio+iostream cruft) produces both leaner, cleaner and *smaller* code / binary sizes for moderate to large embedded applications.
+// I'm more interested in *large* *desktop/server* applications here, and while I loath/don't like the std::expected non-answer for error propagation (you're still doing it and your code is loaded with checks anyhow!), it's better than not having std::expected and std::optional around -- while I don't like to use exceptions for regular error handling.
+//
+// Anyway, the major valid complaint, AFAIAC, about the std::exception class hierarchy is its non-modifiable and rather restricted error info carrying capacity (a const message string), so we're NOT going to use std::exception for our std::expected-based error propagation here.
+// I also agree with the 'out of memory is a system-fatal error' view, so we have *heap allocated* error information object(s), where we pass around pointers to these objects.
+//
+// Still of two minds about reference-counting vs. single ownership (std::unique_ptr<T>) though, where I'm leaning towards single-ownership...
+namespace pathutils {
+
+	// I like the VMS / WindowsNT approach of having error codes as simple integers, divided into zones, carrying both a 'category/library/namespace' id and error id.
+	union ErrorCode {
+		uint32_t value{0};
+
+		struct alignas(4) Fields {
+			enum Severity : unsigned int {
+				ECS_SEVERITY_PASS = 0,
+				ECS_SEVERITY_ERROR,
+				ECS_SEVERITY_CATASTROPHIC
+			} severity : 2;						// pass/fail/abort level indicator for fast checks
+			unsigned int nameSpace : 10;		// which library / namespace this one's part of 
+			unsigned int id : 32 - 10 - 2;		// error id within that library / category / namespace
+		} f;
+	};
+
+	// ErrorInfo instances are always heap allocated (using `mkErrorInfo()` factory function), and passed around as `std::unique_ptr<ErrorInfo>` pointers inside std::expected<T, ErrorInfoPtr> return values.
+	class ErrorInfo {
+	public:
+		explicit ErrorInfo(const std::string &msg) :
+			message(msg)
+		{}
+		virtual ~ErrorInfo()
+		{
+		}
+
+		ErrorCode errorCode{0};
+		std::string message;
+
+		// userland may inherit from this class and/or extend this class instance's heap space to store additional data to be logged or used in other ways when dealing with this specific error.
+	};
+
+	using ErrorInfoPtr = std::unique_ptr<ErrorInfo>;
+
+	// The zero-allocation error channel: an ErrorCode plus the input offset where the error was detected. Reporting an error this way
+	// costs no more than a successful run, as nothing is allocated or formatted until someone actually asks for the message.
+	//
+	// The messages live in static per-namespace tables, indexed by the error id: pathutils' own table is registered for
+	// PATHUTILS_ERROR_NAMESPACE; userland may register its own table(s) for other namespace ids via register_error_messages().
+
+	constexpr unsigned int PATHUTILS_ERROR_NAMESPACE = 1;
+
+	// the error ids of PATHUTILS_ERROR_NAMESPACE:
+	enum SanitationErrorId : unsigned int {
+		SANI_ERR_OK = 0,
+		SANI_ERR_INPUT_NOT_FULLY_PROCESSED,		// the processor quit before it had processed the entire input
+		SANI_ERR_STAGE_STALLED,					// a ProcessorChain stage did not consume its input
+		SANI_ERR_INVALID_INPUT,					// the input cannot be sanitized
+		SANI_ERR_OUTPUT_TOO_LONG,				// the sanitized output would exceed the length limit
+
+		SANI_ERR_COUNT							// never use!
+	};
+
+	inline ErrorCode make_error_code(unsigned int nameSpace, unsigned int id, ErrorCode::Fields::Severity severity = ErrorCode::Fields::ECS_SEVERITY_ERROR) {
+		ErrorCode code;
+		code.f.severity = severity;
+		code.f.nameSpace = nameSpace;
+		code.f.id = id;
+		return code;
+	}
+
+	inline ErrorCode make_error_code(SanitationErrorId id) {
+		return make_error_code(PATHUTILS_ERROR_NAMESPACE, id);
+	}
+
+	struct ErrorMessageTable {
+		const char * const *messages{nullptr};
+		size_t count{0};
+	};
+
+	// the message table registry: one slot per namespace id. pathutils' own table is pre-registered.
+	inline ErrorMessageTable *error_message_tables(void) {
+		static const char * const pathutils_messages[SANI_ERR_COUNT] = {
+			"OK",
+			"Sanitization failed: the input wasn't processed in its entirety",
+			"Sanitization failed: a chained processor stage did not consume its input",
+			"Sanitization failed: invalid input",
+			"Sanitization failed: the output would be too long",
+		};
+		static ErrorMessageTable tables[1 << 10] = {
+			{},
+			{ pathutils_messages, SANI_ERR_COUNT },
+		};
+		return tables;
+	}
+
+	// register the messages for namespace `nameSpace`, indexed by error id. The table must outlive its use.
+	inline void register_error_messages(unsigned int nameSpace, const char * const *messages, size_t count) {
+		error_message_tables()[nameSpace & ((1 << 10) - 1)] = { messages, count };
+	}
+
+	inline const char *error_message(ErrorCode code) {
+		const ErrorMessageTable &table = error_message_tables()[code.f.nameSpace];
+		if (code.f.id < table.count && table.messages[code.f.id])
+			return table.messages[code.f.id];
+		return "Sanitization failed: unknown error";
+	}
+
+	struct ErrorStatus {
+		ErrorCode code{};
+		size_t offset{0};
+
+		[[nodiscard]] bool fail(void) const {
+			return code.f.severity != ErrorCode::Fields::ECS_SEVERITY_PASS;
+		}
+		explicit operator bool() const {
+			return fail();
+		}
+
+		[[nodiscard]] const char *message(void) const {
+			return error_message(code);
+		}
+
+		// lazy formatting into a caller-supplied buffer: returns the length of the full message, cf. snprintf().
+		size_t format(char *buf, size_t bufsize) const {
+			int len = snprintf(buf, bufsize, "%s (at input offset %zu; error %u:%u)", message(), offset, (unsigned int)code.f.nameSpace, (unsigned int)code.f.id);
+			return len < 0 ? 0 : (size_t)len;
+		}
+
+		std::string to_string(void) const {
+			char buf[256];
+			size_t len = format(buf, sizeof(buf));
+			if (len < sizeof(buf))
+				return std::string(buf, len);
+			std::string rv(len, 0);
+			format(rv.data(), len + 1);
+			return rv;
+		}
+	};
+}
+#endif
+
+namespace pathutils {
+
+	// The output of the sanitize() driver: processors append their output straight into this one, instead of returning
+	// a fresh std::string for every element, which would cost a heap allocation plus a copy per element.
+	//
+	// The sink writes either into a caller-provided std::string (whose capacity is reused across runs) or into a new
+	// entry of an output_arena, so a series of inputs can be sanitized back to back into a single buffer.
+	class output_sink {
+	public:
+		explicit output_sink(std::string &dst) :
+			str_(&dst),
+			start_(dst.size())
+		{}
+		// appends a new entry to `arena`, which is sealed by finish().
+		explicit output_sink(output_arena &arena) :
+			arena_(&arena),
+			start_(arena.data.size())
+		{
+			if (arena.offsets.empty())
+				arena.offsets.push_back(start_);
+		}
+
+		void append(std::string_view s) {
+			if (str_)
+				str_->append(s);
+			else
+				arena_->data.insert(arena_->data.end(), s.begin(), s.end());
+		}
+		void push_back(char c) {
+			if (str_)
+				str_->push_back(c);
+			else
+				arena_->data.push_back(c);
+		}
+
+		// the number of bytes written into this sink so far.
+		size_t size() const {
+			return (str_ ? str_->size() : arena_->data.size()) - start_;
+		}
+		// a view of the bytes written into this sink so far: only valid until the next write.
+		std::string_view view() const {
+			return str_ ? std::string_view(*str_).substr(start_) : std::string_view(arena_->data.data() + start_, arena_->data.size() - start_);
+		}
+		// drop all but the first `n` bytes written so far, e.g. when a processor must trim trailing whitespace.
+		void truncate(size_t n) {
+			if (n < size()) {
+				if (str_)
+					str_->resize(start_ + n);
+				else
+					arena_->data.resize(start_ + n);
+			}
+		}
+
+		// forget about the output written so far, after the caller has consumed it and cleared the std::string: see sanitize_stream.
+		void rebase() {
+			start_ = (str_ ? str_->size() : arena_->data.size());
+		}
+
+		// seal the output: for an arena this terminates the entry and registers it.
+		void finish() {
+			if (arena_) {
+				arena_->data.push_back(0);
+				arena_->offsets.push_back(arena_->data.size());
+			}
+		}
+
+	private:
+		std::string *str_{nullptr};
+		output_arena *arena_{nullptr};
+		size_t start_;
+	};
+
+	// interface definition according to https://en.wikipedia.org/wiki/Curiously_recurring_template_pattern, bacause, well, good grief, this is C++, not C# or Java, now is it?
+	template <typename T>
+	class SanitationProcessorBase {
+	public:
+		// -------------- overridable methods -----------------------------------
+
+		std::string process_start(std::string_view &input, size_t& offset) {
+			return static_cast<T *>(this)->process_start(input, offset);
+		}
+
+		std::string process_element(const std::string_view input, size_t& offset) {
+			return static_cast<T *>(this)->process_element(input, offset);
+		}
+
+		// The output_sink flavour of the processor interface, used by the sanitize() driver when the userland processor implements it:
+		// instead of returning their output, these append it to `output`.
+		void process_start(std::string_view &input, size_t& offset, output_sink &output) {
+			static_cast<T *>(this)->process_start(input, offset, output);
+		}
+
+		void process_element(const std::string_view input, size_t& offset, output_sink &output) {
+			static_cast<T *>(this)->process_element(input, offset, output);
+		}
+
+		// Note: because `process_end()` returns an *owning* error info pointer, it must be marked [[nodiscard]] to avoid silent loss of error info!
+		//
+		// This interface was designed with the intention that the processor instance itself keeps track of any error info which occurs during processing
+		// where, at the end of the process, `process_end()` produces that info and passes the responsibility to the caller. This would
+		// *implicitly* *clear* the error for the next process run, thus making `process_end()` truly the final call that's involved with
+		// the current run: start, process elements, end. Nothing more to do, everything is cleared and ready for another go.
+		[[nodiscard]] ErrorInfoPtr process_end(std::string &output, std::string_view &input, size_t offset) {
+			return static_cast<T *>(this)->process_end(output, input, offset);
+			// return error_;
+		}
+
+		//
+		// The output_sink flavour reports errors through the zero-allocation ErrorStatus channel: see `set_error()` and `take_error_status()`.
+		[[nodiscard]] ErrorStatus process_end(output_sink &output, std::string_view &input, size_t offset) {
+			return static_cast<T *>(this)->process_end(output, input, offset);
+		}
+
+		// Use this check in your processing loop to see if all is done or an error occurred. Userland implementations should implement the exact check
+		// themselves, where part of that SHOULD be a call to `failed()` to see if an actual failure (error) has been registered.
+		bool all_done_or_fail(const std::string_view &input, size_t &offset) {
+			return static_cast<T *>(this)->all_done_or_fail(input, offset);
+		}
+
+		// ---------------------------------------------------------------------
+
+		[[nodiscard]] bool failed(void) const {
+			return !!error_ || status_.fail();
+		}
+		void clear_error(void) {
+			error_ = nullptr;
+			status_ = {};
+		}
+		[[nodiscard]] ErrorInfo * peek_error_info(void) const {
+			return error_.get();
+		}
+		void set_error_info(const std::string &msg) {
+			error_ = std::make_unique<ErrorInfo>(msg);
+		}
+		// in case you (userland) have your own ErrorInfo-derived class and wish to use that one:
+		void set_error_info(ErrorInfo *err) {
+			error_ = err;
+		}
+
+		// the zero-allocation error channel: only the first error of a run is kept.
+		void set_error(ErrorCode code, size_t offset) {
+			if (!status_.fail())
+				status_ = { code, offset };
+		}
+		[[nodiscard]] const ErrorStatus &peek_error_status(void) const {
+			return status_;
+		}
+		// produce the error status and clear it for the next run.
+		[[nodiscard]] ErrorStatus take_error_status(void) {
+			ErrorStatus rv = status_;
+			status_ = {};
+			return rv;
+		}
+
+
+		// When fed by the sanitize_stream driver, the input arrives in chunks and an element may straddle two chunks, e.g. half a UTF-8
+		// sequence or a half-seen `%2` escape. While `end_of_input()` is false, a processor which sees such an incomplete element at the
+		// end of its input should return from `process_element()` *without* advancing `offset`: the driver then carries the unprocessed
+		// tail over to the next chunk. Once `end_of_input()` is true, the processor must consume all of its input.
+		[[nodiscard]] bool end_of_input(void) const {
+			return end_of_input_;
+		}
+		void set_end_of_input(bool eoi) {
+			end_of_input_ = eoi;
+		}
+
+	protected:
+		ErrorInfoPtr error_{};
+		ErrorStatus status_{};
+		bool end_of_input_{true};
+	};
+
+	// and one very rudimentary demo implementation of a SanitationProcessorBase-derived class:
+	class BasicSanitationProcessorDemo: public SanitationProcessorBase<BasicSanitationProcessorDemo> {
+	public:
+		std::string process_start(std::string_view &, size_t&) {
+			return {};
+		}
+
+		std::string process_element(const std::string_view, size_t&) {
+			return "x";
+		}
+
+		[[nodiscard]] ErrorInfoPtr process_end(std::string &, std::string_view &, size_t) {
+			return std::move(error_);
+		}
+
+		bool all_done_or_fail(const std::string_view &input, size_t &) {
+			return failed() || input.empty();
+		}
+	};
+
+	// and all that done merely to keep this bit DRY. Sans virtual functions, my my, oh dear, oh dear.
+	//
+	// NOTE: we don't use std::expected but std::tuple instead here to avoid the whole mess with std::expected and non-copyable error types. (LWG/issue3938)
+	// 
+	// Besides, from my perspective, returned *values* and *errors* are *co-existent*, i.e. you CAN have BOTH a value and an error at the same time.
+	// Of course, the *value* will be a buggered/untrusty one when you have an error, but you MAY have something of a value anyway, that
+	// you can look at in any diagnostic output. std::expected doesn't work that way: it's either/or.
+	//
+	// Because we only have TWO return items (string value + error instance ref) we use the specialized std::pair instead of std::tuple.
+	//
+	// [Edit:] as I find std::pair adds very little to the readability of this thing, we reduce to a basic return struct carrying both value and error.
+
+	struct SaniResult {
+		std::string value;
+		ErrorInfoPtr error;
+
+		[[nodiscard]] bool fail(void) const {
+			return !!error;
+		}
+	};
+
+#if 0
+	template <typename T>
+	std::expected<std::string, ErrorInfoPtr> sanitize(std::string_view input, SanitationProcessorBase<T> &processor, size_t offset = 0) {
+		// process start: initialize output and do any userland preparation your custom SanitationProcessor might need.
+		std::string output = processor.process_start(input, offset);
+		while (!processor.all_done_or_fail(input, offset)) {
+			// process element: the userland-defined process_element() decides what 'an element' is to be,
+			// so we just keep calling it until all is done or an error occurs.
+			// Meanwhile, process_element() will update the input std::string_view to remove the processed part.
+			output += processor.process_element(input, offset);
+		}
+		// process end: finalize output, report any errors which occurred along the way.
+		auto ex = processor.process_end(output, input, offset);
+		if (ex != nullptr) {
+			return std::unexpected(std::move(ex));
+		}
+		// extra check: make sure the entire input has been processed
+		if (!input.empty()) {
+			return std::unexpected(std::make_unique<ErrorInfo>("Sanitization failed: the input wasn't procesed in its entirety"));
+		}
+		return output;
+	}
+#else
+	// does the userland processor implement the output_sink flavour of the processor interface?
+	template <typename T>
+	concept SinkSanitationProcessor = requires (T &processor, std::string_view &input, size_t &offset, output_sink &output) {
+		processor.process_start(input, offset, output);
+		processor.process_element(std::string_view(input), offset, output);
+		{ processor.process_end(output, input, offset) } -> std::same_as<ErrorStatus>;
+	};
+
+	// The output_sink driver: the processor appends its output straight into `output`, so no intermediate strings are constructed along the way.
+	// Returns the error status, which does not allocate, not even on failure.
+	template <typename T>
+		requires SinkSanitationProcessor<T>
+	[[nodiscard]] ErrorStatus sanitize(std::string_view input, SanitationProcessorBase<T> &processor, output_sink &output, size_t offset = 0) {
+		processor.process_start(input, offset, output);
+		while (!processor.all_done_or_fail(input, offset)) {
+			processor.process_element(input, offset, output);
+		}
+		size_t input_size = input.size();
+		ErrorStatus error = processor.process_end(output, input, offset);
+		if (!error.fail() && !input.empty()) {
+			error = { make_error_code(SANI_ERR_INPUT_NOT_FULLY_PROCESSED), input_size - input.size() };
+		}
+		output.finish();
+		return error;
+	}
+
+	template <typename T>
+	SaniResult sanitize(std::string_view input, SanitationProcessorBase<T> &processor, size_t offset = 0) {
+		// processors which can append to an output_sink do so directly into our result string.
+		if constexpr (SinkSanitationProcessor<T>) {
+			SaniResult rv;
+			output_sink output(rv.value);
+			ErrorStatus error = sanitize(input, processor, output, offset);
+			// this API hands out ErrorInfo instances, so we must allocate one now, but only on failure.
+			if (error.fail()) {
+				rv.error = std::make_unique<ErrorInfo>(error.to_string());
+				rv.error->errorCode = error.code;
+			}
+			return rv;
+		}
+		else {
+			// process start: initialize output and do any userland preparation your custom SanitationProcessor might need.
+			SaniResult rv{
+				.value = processor.process_start(input, offset),
+				.error = {}
+			};
+			while (!processor.all_done_or_fail(input, offset)) {
+				// process element: the userland-defined process_element() decides what 'an element' is to be,
+				// so we just keep calling it until all is done or an error occurs.
+				// Meanwhile, process_element() will update the input std::string_view to remove the processed part.
+				rv.value += processor.process_element(input, offset);
+			}
+			// process end: finalize output, report any errors which occurred along the way.
+			rv.error = processor.process_end(rv.value, input, offset);
+			if (rv.fail()) {
+				return rv;
+			}
+			// extra check: make sure the entire input has been processed
+			if (!input.empty()) {
+				rv.error = std::make_unique<ErrorInfo>("Sanitization failed: the input wasn't procesed in its entirety");
+			}
+			return rv;
+		}
+	}
+#endif
+
+	// Fuse several processors into a single processor, e.g. URI-decode -> hash-decode -> ascii-fy -> reserved-name fix -> length limit,
+	// which is fed to the sanitize() driver like any other processor. Instead of running one sanitize() pass per processor, with an
+	// intermediate string in between each pair, the chain makes a single pass over the input: every element produced by a stage is
+	// immediately fed through the next stage, until the last stage appends it to the output. All stages are inlined.
+	//
+	// The first stage decides what 'an element' of the input is; the later stages are fed the output of their predecessor element by
+	// element, i.e. every chunk they're fed is a complete unit of upstream output, e.g. a single path segment.
+	//
+	// The stages must implement the output_sink flavour of the processor interface. The intermediate buffers are kept across runs,
+	// so a chain which is re-used for many inputs does not allocate once its buffers have grown to fit.
+	template <typename... Stages>
+		requires (sizeof...(Stages) >= 1 && (SinkSanitationProcessor<Stages> && ...))
+	class ProcessorChain: public SanitationProcessorBase<ProcessorChain<Stages...>> {
+		static constexpr size_t stage_count = sizeof...(Stages);
+
+	public:
+		ProcessorChain() = default;
+		explicit ProcessorChain(Stages... stages) :
+			stages_(std::move(stages)...)
+		{}
+
+		template <size_t K>
+		auto &stage() {
+			return std::get<K>(stages_);
+		}
+
+		void process_start(std::string_view &input, size_t& offset, output_sink &output) {
+			// each stage's preamble must be fed through the stages after it, so those must be started first.
+			start_stages<stage_count - 1>(input, offset, output);
+		}
+
+		void process_element(const std::string_view input, size_t& offset, output_sink &output) {
+			// only the first stage sees the (streamed) input: the later stages are always fed complete units.
+			std::get<0>(stages_).set_end_of_input(this->end_of_input());
+			emit<0>(output, [&](output_sink &sink) {
+				std::get<0>(stages_).process_element(input, offset, sink);
+			});
+		}
+
+		[[nodiscard]] ErrorStatus process_end(output_sink &output, std::string_view &input, size_t offset) {
+			ErrorStatus error = this->take_error_status();
+			end_stages<0>(output, input, offset, error);
+			return error;
+		}
+
+		bool all_done_or_fail(const std::string_view &input, size_t &offset) {
+			return this->failed() || any_stage_failed() || std::get<0>(stages_).all_done_or_fail(input, offset);
+		}
+
+	private:
+		// run `fn`, which produces output for stage K, and feed that output to the next stage, if there is one.
+		template <size_t K, typename F>
+		void emit(output_sink &output, F &&fn) {
+			if constexpr (K + 1 == stage_count) {
+				fn(output);
+			}
+			else {
+				std::string &buf = buffers_[K];
+				buf.clear();
+				output_sink sink(buf);
+				fn(sink);
+				feed<K + 1>(buf, output);
+			}
+		}
+
+		// feed a chunk of upstream output through stage K and onwards.
+		template <size_t K>
+		void feed(const std::string_view chunk, output_sink &output) {
+			auto &stage = std::get<K>(stages_);
+			size_t offset = 0;
+
+			if (chunk.empty())
+				return;
+			while (!stage.all_done_or_fail(chunk, offset)) {
+				size_t before = offset;
+				emit<K>(output, [&](output_sink &sink) {
+					stage.process_element(chunk, offset, sink);
+				});
+				// a stage which doesn't consume a complete unit would otherwise stall us forever.
+				if (offset == before) {
+					stage.set_error(make_error_code(SANI_ERR_STAGE_STALLED), offset);
+					break;
+				}
+			}
+		}
+
+		template <size_t K>
+		void start_stages(std::string_view &input, size_t& offset, output_sink &output) {
+			if constexpr (K == 0) {
+				emit<0>(output, [&](output_sink &sink) {
+					std::get<0>(stages_).process_start(input, offset, sink);
+				});
+			}
+			else {
+				// only the first stage sees the real input: the others are fed by their predecessor.
+				std::string_view none;
+				size_t none_offset = 0;
+				emit<K>(output, [&](output_sink &sink) {
+					std::get<K>(stages_).process_start(none, none_offset, sink);
+				});
+				start_stages<K - 1>(input, offset, output);
+			}
+		}
+
+		// end the stages in order, feeding each stage's epilogue through the stages after it. The first error wins.
+		template <size_t K>
+		void end_stages(output_sink &output, std::string_view &input, size_t offset, ErrorStatus &error) {
+			ErrorStatus e;
+			if constexpr (K == 0) {
+				emit<0>(output, [&](output_sink &sink) {
+					e = std::get<0>(stages_).process_end(sink, input, offset);
+				});
+			}
+			else {
+				std::string_view none;
+				emit<K>(output, [&](output_sink &sink) {
+					e = std::get<K>(stages_).process_end(sink, none, 0);
+				});
+			}
+			if (!error.fail())
+				error = e;
+			if constexpr (K + 1 < stage_count)
+				end_stages<K + 1>(output, input, offset, error);
+		}
+
+		bool any_stage_failed() const {
+			return std::apply([](const auto &... stage) {
+				return (stage.failed() || ...);
+			}, stages_);
+		}
+
+		std::tuple<Stages...> stages_;
+		std::string buffers_[stage_count > 1 ? stage_count - 1 : 1];
+	};
+
+	// The streaming driver: sanitize an input which arrives in chunks, e.g. a multi-megabyte manifest piped through stdin,
+	// without buffering it whole. Feed it the chunks in order, then call finish() to flush and collect the error status:
+	//
+	//     std::string out;
+	//     output_sink sink(out);
+	//     sanitize_stream stream(processor, sink);
+	//     while (read a chunk) {
+	//         stream.feed(chunk);
+	//         consume out, then: out.clear(); sink.rebase();
+	//     }
+	//     auto error = stream.finish();
+	//
+	// Elements which straddle a chunk boundary are handled as described at `SanitationProcessorBase::end_of_input()`: the driver
+	// keeps the unprocessed tail of a chunk, which is normally only a few bytes, and prepends it to the next one.
+	template <typename T>
+		requires SinkSanitationProcessor<T>
+	class sanitize_stream {
+	public:
+		sanitize_stream(SanitationProcessorBase<T> &processor, output_sink &output) :
+			processor_(processor),
+			output_(output)
+		{}
+
+		void feed(std::string_view chunk) {
+			processor_.set_end_of_input(false);
+			start(chunk);
+
+			if (!carry_.empty()) {
+				// glue the carried-over tail to the head of this chunk, in steps which at least double the carry buffer,
+				// until the processor has eaten its way past the carried-over tail: from there on, it continues in the chunk itself.
+				size_t tail = carry_.size();
+				size_t taken = 0;
+				for (;;) {
+					size_t step = std::min(chunk.size() - taken, std::max<size_t>(carry_.size(), 16));
+					carry_.append(chunk.substr(taken, step));
+					taken += step;
+
+					size_t offset = run(carry_);
+					if (offset >= tail || processor_.failed()) {
+						// continue at the chunk position the processor has reached.
+						taken -= std::min(taken, carry_.size() - offset);
+						carry_.clear();
+						break;
+					}
+					carry_.erase(0, offset);
+					tail -= offset;
+					if (taken == chunk.size())
+						return;
+				}
+				chunk.remove_prefix(taken);
+			}
+
+			size_t offset = run(chunk);
+			if (offset < chunk.size() && !processor_.failed())
+				carry_.assign(chunk.substr(offset));
+		}
+
+		// flush the carried-over tail, if any, and end the run: returns the error status.
+		[[nodiscard]] ErrorStatus finish() {
+			processor_.set_end_of_input(true);
+			std::string_view rest(carry_);
+			start(rest);
+
+			size_t offset = run(rest);
+			size_t rest_size = rest.size();
+			ErrorStatus error = processor_.process_end(output_, rest, offset);
+			if (!error.fail() && !rest.empty()) {
+				error = { make_error_code(SANI_ERR_INPUT_NOT_FULLY_PROCESSED), rest_size - rest.size() };
+			}
+			output_.finish();
+
+			carry_.clear();
+			started_ = false;
+			return error;
+		}
+
+	private:
+		void start(std::string_view &input) {
+			if (!started_) {
+				size_t offset = 0;
+				processor_.process_start(input, offset, output_);
+				input.remove_prefix(offset);
+				started_ = true;
+			}
+		}
+
+		// process elements until all is done, an error occurs, or the processor wants to see more input: returns the offset reached.
+		size_t run(const std::string_view input) {
+			size_t offset = 0;
+			while (!processor_.all_done_or_fail(input, offset)) {
+				size_t before = offset;
+				processor_.process_element(input, offset, output_);
+				if (offset == before)
+					break;
+			}
+			return offset;
+		}
+
+		SanitationProcessorBase<T> &processor_;
+		output_sink &output_;
+		std::string carry_;
+		bool started_{false};
+	};
+
+}
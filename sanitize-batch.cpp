@@ -0,0 +1,129 @@
+
+#include "pathutils.hpp"
+#include "pathutils.h"
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+#include <string.h>
+
+// Batch sanitization.
+//
+// Sanitizing millions of paths one call at a time costs an output allocation per path, plus the loop
+// overhead in the caller. sanitize_batch() instead lays out all results in a single arena, which is
+// sized once, up front, for the worst case: the sanitizer never produces more bytes than it is fed,
+// so every path gets a slot of its own input length plus a NUL sentinel.
+//
+// The batch is cut into contiguous slices, one per worker thread. Each worker sanitizes its paths
+// straight into its own part of the arena, packing them back to back as it goes; as the slices are
+// disjoint, the workers never need to synchronize. Once all workers are done, the calling thread
+// closes the gaps between the slices with one memmove() per slice.
+
+namespace pathutils {
+
+	namespace {
+
+		// don't bother spinning up a thread for fewer paths than this: the thread start-up would cost more than it saves.
+		constexpr size_t min_paths_per_thread = 1024;
+
+		struct batch_slice
+		{
+			size_t first;             // index of the first path in this slice
+			size_t last;              // one beyond the index of the last path in this slice
+			size_t begin;             // arena offset where this slice starts
+			size_t end;               // arena offset where the packed output of this slice ends
+		};
+
+		// as the sanitizers work on NUL-terminated strings, an embedded NUL terminates the path.
+		size_t path_length(std::string_view path)
+		{
+			const void *nul = memchr(path.data(), 0, path.size());
+			return nul ? (const char *)nul - path.data() : path.size();
+		}
+
+		void sanitize_slice(std::span<const std::string_view> paths, output_arena &dst, const pathutils_sanitize_policy *policy, batch_slice &slice)
+		{
+			char *base = dst.data.data();
+			char *w = base + slice.begin;
+
+			for (size_t i = slice.first; i < slice.last; i++) {
+				size_t len = path_length(paths[i]);
+
+				memcpy(w, paths[i].data(), len);
+				w[len] = 0;
+				fz_sanitize_path_with_policy(w, policy, 0, len + 1);
+
+				dst.offsets[i] = w - base;
+				w += strlen(w) + 1;
+			}
+
+			slice.end = w - base;
+		}
+
+	}
+
+	void sanitize_batch(std::span<const std::string_view> paths, output_arena &dst, const pathutils_sanitize_policy *policy, unsigned int thread_count)
+	{
+		const size_t n = paths.size();
+
+		// worst-case layout: every path at its full input length.
+		size_t total = 0;
+		dst.offsets.resize(n + 1);
+		for (size_t i = 0; i < n; i++) {
+			dst.offsets[i] = total;
+			total += path_length(paths[i]) + 1;
+		}
+		dst.offsets[n] = total;
+		dst.data.resize(total);
+
+		if (n == 0)
+			return;
+
+		if (thread_count == 0)
+			thread_count = std::max(1U, std::thread::hardware_concurrency());
+		size_t slice_count = std::min<size_t>(thread_count, (n + min_paths_per_thread - 1) / min_paths_per_thread);
+
+		std::vector<batch_slice> slices(slice_count);
+		for (size_t j = 0; j < slice_count; j++) {
+			batch_slice &slice = slices[j];
+			slice.first = n * j / slice_count;
+			slice.last = n * (j + 1) / slice_count;
+			slice.begin = dst.offsets[slice.first];
+			slice.end = slice.begin;
+		}
+
+		// the calling thread takes the first slice itself. When we cannot get (enough) threads,
+		// we process the remaining slices on the calling thread as well.
+		std::vector<std::thread> workers;
+		workers.reserve(slice_count - 1);
+		size_t k = 1;
+		try {
+			for (; k < slice_count; k++)
+				workers.emplace_back(sanitize_slice, paths, std::ref(dst), policy, std::ref(slices[k]));
+		}
+		catch (const std::system_error &) {
+		}
+		sanitize_slice(paths, dst, policy, slices[0]);
+		for (size_t j = k; j < slice_count; j++)
+			sanitize_slice(paths, dst, policy, slices[j]);
+		for (auto &worker : workers)
+			worker.join();
+
+		// close the gaps between the slices
+		size_t w = slices[0].end;
+		for (size_t j = 1; j < slice_count; j++) {
+			const batch_slice &slice = slices[j];
+			size_t shift = slice.begin - w;
+
+			if (shift) {
+				memmove(dst.data.data() + w, dst.data.data() + slice.begin, slice.end - slice.begin);
+				for (size_t i = slice.first; i < slice.last; i++)
+					dst.offsets[i] -= shift;
+			}
+			w += slice.end - slice.begin;
+		}
+		dst.offsets[n] = w;
+		dst.data.resize(w);
+	}
+
+}
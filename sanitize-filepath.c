@@ -3,11 +3,13 @@
 #include "mupdf/helpers/dir.h"
 #include "mupdf/helpers/system-header-files.h"
 #include "utf.h"
+#include "pathutils.h"
 
 #ifdef _MSC_VER
 #include <direct.h> /* for mkdir */
 #else
 #include <unistd.h>
+#include <fcntl.h>
 #endif
 #include <errno.h>
 #include <string.h>
@@ -20,6 +22,31 @@
 #include <sys/stat.h>
 
 
+// The number of directory levels fz_normalize_path() can track on its stack; deeper paths are still handled correctly, but slower.
+#define FZ_NORMALIZE_PATH_STACK_DEPTH    64
+
+// Return the start of the last directory element retained by fz_normalize_path(), i.e. the spot where
+// the output will continue after a ../ has killed that directory.
+static char* fz_normalize_path_pop(char* start, char* w, const size_t* popstack, size_t depth)
+{
+	if (depth <= FZ_NORMALIZE_PATH_STACK_DEPTH)
+		return start + popstack[depth - 1];
+
+	// too deep for the stack: scan back to previous /
+	char* p = w - 2;
+	while (p > start && p[-1] != '/')
+		p--;
+	return p;
+}
+
+// Check whether the last directory element retained by fz_normalize_path() is itself a ../ directory, which cannot be killed by another ../
+static int fz_normalize_path_pop_is_dotdot(char* start, char* w, const size_t* popstack, size_t depth)
+{
+	const char* p = fz_normalize_path_pop(start, w, popstack, depth);
+	return (w - p == 3 && p[0] == '.' && p[1] == '.');
+}
+
+
 /**
  * Normalize a given path, i.e. resolve the ./ and ../ directories that may be part of it.
  * Also UNIXify the path by replacing \ backslashes with / slashes, which work on all platforms.
@@ -37,17 +64,13 @@ void fz_normalize_path(fz_context* ctx, char* dstpath, size_t dstpath_bufsize, c
 	if (!dstpath)
 		fz_throw(ctx, FZ_ERROR_GENERIC, "fz_normalize_path: dstpath cannot be NULL.");
 	// copy source path, if it isn't already in the work buffer:
-	size_t len;
 	if (path) {
-		len = strlen(path);
+		size_t len = strlen(path);
 		if (dstpath_bufsize < len + 1)
 			fz_throw(ctx, FZ_ERROR_GENERIC, "fz_normalize_path: buffer overrun.");
 		if (path != dstpath)
 			memmove(dstpath, path, len + 1);
 	}
-	else {
-		len = strlen(dstpath);
-	}
 
 	// unixify MSDOS path:
 	char* e = strchr(dstpath, '\\');
@@ -61,7 +84,7 @@ void fz_normalize_path(fz_context* ctx, char* dstpath, size_t dstpath_bufsize, c
 
 	// Sanitize the *entire* path, including the Windows Drive/Share part:
 	e = dstpath;
-	if (e[0] == '/' && e[1] == '/' && strchr(".?", e[2]) != NULL && e[3] == '/')
+	if (e[0] == '/' && e[1] == '/' && e[2] && strchr(".?", e[2]) != NULL && e[3] == '/')
 	{
 		// skip //?/ and //./ UNC leaders
 		e += 4;
@@ -85,98 +108,95 @@ void fz_normalize_path(fz_context* ctx, char* dstpath, size_t dstpath_bufsize, c
 
 	char* start = e;
 
-	// now find ./ and ../ directories and resolve each, if possible:
-	char* p = start;
-	e = strchr(*p ? p + 1 : p, '/');  // skip root /, if it (may) exist
+	// now find ./ and ../ directories and resolve each, if possible.
+	//
+	// This is done in a single pass: `r` is the read cursor, `w` the write cursor, where `w <= r` at all times, so we can work in place.
+	// Every directory element we keep is copied to `w` (when it isn't there already), while we push its start
+	// offset onto a small stack, so a ../ can pop the parent in O(1) instead of scanning back for the previous /.
+	// Paths nested deeper than the stack can hold fall back to scanning back for that previous /, which produces the exact same result.
+	size_t popstack[FZ_NORMALIZE_PATH_STACK_DEPTH];
+	size_t depth = 0;
+	const char* r = start;
+	char* w = start;
+
+	e = strchr(*r ? r + 1 : r, '/');  // skip root /, if it (may) exist
 	while (e)
 	{
-		if (e == p) {
+		size_t seglen = e - r;
+
+		if (seglen == 0) {
 			// matched an extra / (as in the second / of  '//'): that one can be killed
-			//memmove(p, e + 1, len + 1 - (e + 1 - dstpath));  -->
-			memmove(p, e + 1, len - (e - dstpath));
-			len -= e + 1 - p;
 		}
-		else if (strncmp(p, ".", e - p) == 0) {
+		else if (seglen == 1 && r[0] == '.') {
 			// matched a ./ directory: that one can be killed
-			//memmove(p, e + 1, len + 1 - (e + 1 - dstpath));  -->
-			memmove(p, e + 1, len - (e - dstpath));
-			len -= e + 1 - p;
 		}
-		else if (strncmp(p, "..", e - p) == 0) {
+		else if (seglen == 2 && r[0] == '.' && r[1] == '.' && depth > 0 &&
+			!fz_normalize_path_pop_is_dotdot(start, w, popstack, depth)) {
 			// matched a ../ directory: that can only be killed when there's a parent available
 			// which is not itself already a ../
-			if (p - 2 >= start) {
-				// scan back to previous /
-				p -= 2;
-				while (p > start && p[-1] != '/')
-					p--;
-				// make sure we have backtracked over a directory that is not itself named ../
-				if (strncmp(p, "../", 3) != 0) {
-					//memmove(p, e + 1, len + 1 - (e + 1 - dstpath));  -->
-					memmove(p, e + 1, len - (e - dstpath));
-					len -= e + 1 - p;
-				}
-				else {
-					// otherwise, we're stuck with this ../ that we currently have.
-					p = e + 1;
-				}
-			}
-			else {
-				// no parent available at all...
-				// hence we're stuck with this ../ that we currently have.
-				p = e + 1;
-			}
+			w = fz_normalize_path_pop(start, w, popstack, depth);
+			depth--;
 		}
 		else {
-			// we now have a directory that's not ./ nor ../
-			// hence keep as is
-			p = e + 1;
+			// we now have a directory that's not ./ nor ../ -- or a ../ which we're stuck with as there's
+			// no parent available, or the parent is a ../ itself -- hence keep as is.
+			size_t top = w - start;
+			// the root / is part of the first directory element, but we must never pop it off:
+			if (top == 0 && r[0] == '/' && seglen >= 2)
+				top++;
+			if (depth < FZ_NORMALIZE_PATH_STACK_DEPTH)
+				popstack[depth] = top;
+			depth++;
+
+			if (w != r)
+				memmove(w, r, seglen);
+			w += seglen;
+			*w++ = '/';
 		}
-		e = strchr(p, '/');
+		r = e + 1;
+		e = strchr(r, '/');
 	}
 
 	// we now have the special case, where the path ends with a directory named . or .., which does not come with a trailing /
-	if (strcmp(p, ".") == 0) {
+	if (strcmp(r, ".") == 0) {
 		// matched a ./ directory: that one can be killed
-		if (p - 1 > start) {
+		if (w - 1 > start) {
 			// keep this behaviour of no / at end (unless we were processing the fringe case '/.'):
-			p--;
+			w--;
 		}
-		*p = 0;
+		*w = 0;
 	}
-	else if (strcmp(p, "..") == 0) {
+	else if (strcmp(r, "..") == 0 && depth > 0 &&
+		!fz_normalize_path_pop_is_dotdot(start, w, popstack, depth)) {
 		// matched a ../ directory: that can only be killed when there's a parent available
 		// which is not itself already a ../
-		if (p - 2 >= start) {
-			// scan back to previous /
-			p -= 2;
-			while (p > start && p[-1] != '/')
-				p--;
-			// make sure we have backtracked over a directory that is not itself named ../
-			if (strncmp(p, "../", 3) != 0) {
-				if (p - 1 > start) {
-					// keep this behaviour of no / at end (unless we were processing the fringe case '/..', which is illegal BTW):
-					p--;
-				}
-				else if (p - 1 == start) {
-					fz_throw(ctx, FZ_ERROR_GENERIC, "fz_normalize_path: illegal /.. path.");
-				}
-				*p = 0;
-			}
-			// otherwise, we're stuck with this ../ that we currently have.
+		char* p = fz_normalize_path_pop(start, w, popstack, depth);
+		if (p - 1 > start) {
+			// keep this behaviour of no / at end (unless we were processing the fringe case '/..', which is illegal BTW):
+			p--;
+		}
+		else if (p - 1 == start) {
+			fz_throw(ctx, FZ_ERROR_GENERIC, "fz_normalize_path: illegal /.. path.");
 		}
-		// else: no parent available at all...
-		// hence we're stuck with this ../ that we currently have.
+		*p = 0;
+	}
+	else {
+		// otherwise, we're stuck with this ../ that we currently have, or it's a plain file or directory name.
+		if (w != r)
+			memmove(w, r, strlen(r) + 1);
 	}
 }
 
 
-static uint64_t calchash(const char* s) {
-	uint64_t x = 0x33333333CCCCCCCCULL;
+// The path hash is calculated incrementally: start with CALCHASH_SEED, feed it any number of byte ranges
+// via calchash_feed(), then produce the final hash value via calchash_finish().
+#define CALCHASH_SEED    0x33333333CCCCCCCCULL
+
+static uint64_t calchash_feed(uint64_t x, const char* s, const char* end) {
 	const uint8_t* p = (const uint8_t*)s;
 
 	// hash/reduction inspired by Xorshift64
-	for (; *p; p++) {
+	for (; p < (const uint8_t*)end; p++) {
 		uint64_t c = *p;
 		x ^= c << 26;
 		x += c;
@@ -186,6 +206,10 @@ static uint64_t calchash(const char* s) {
 		x ^= x << 17;
 	}
 
+	return x;
+}
+
+static uint64_t calchash_finish(uint64_t x) {
 	x ^= x << 13;
 	x ^= x >> 7;
 	x ^= x << 17;
@@ -194,46 +218,316 @@ static uint64_t calchash(const char* s) {
 }
 
 
-#include "../../scripts/legal_codepoints_bitmask.inc"
-
+#include "legal_codepoints_trie.inc"
 
-static int has_prefix(const char* s, const char* prefix)
+// Return TRUE when codepoint `u` is a Unicode Letter (L*) or Number (N*), across the entire Unicode range.
+// See legal_codepoints_trie.py: at most two (cache line) loads.
+static inline int fz_is_legal_codepoint(int u)
 {
-	size_t len = strlen(prefix);
-	return fz_strncasecmp(s, prefix, len) == 0;
+	if ((unsigned int)u > LEGAL_CODEPOINTS_MAX)
+		return 0;
+	const uint32_t* block = legal_codepoints_trie_blocks[legal_codepoints_trie_index[u >> LEGAL_CODEPOINTS_BLOCK_SHIFT]];
+	return (block[(u >> 5) & 7] >> (u & 31)) & 1;
 }
 
-static int has_postfix(const char* s, const char* postfix)
+
+// Return TRUE when `infix` occurs anywhere in the `len` bytes at `s`, ignoring case.
+// memchr() hops from candidate to candidate; as it matches exactly, the first character of `infix` must not be a letter.
+static int has_infix(const char* s, size_t len, const char* infix)
 {
-	size_t len = strlen(postfix);
-	size_t slen = strlen(s);
-	if (slen < len)
+	size_t infix_len = strlen(infix);
+	if (len < infix_len)
 		return 0;
-	return fz_strcasecmp(s + slen - len, postfix) == 0;
+	// one beyond the last position where `infix` can start:
+	const char* end = s + len - infix_len + 1;
+	for (const char* p = s; (p = (const char*)memchr(p, infix[0], end - p)) != NULL; p++)
+	{
+		if (fz_strncasecmp(p + 1, infix + 1, infix_len - 1) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FZ_SANITIZE_HAS_AVX2    1
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FZ_SANITIZE_HAS_SSE2    1
+#endif
+
+#if defined(FZ_SANITIZE_HAS_AVX2) || defined(FZ_SANITIZE_HAS_SSE2)
+static inline unsigned int fz_count_trailing_zeros(uint32_t v)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long idx;
+	_BitScanForward(&idx, v);
+	return idx;
+#else
+	return __builtin_ctz(v);
+#endif
+}
+#endif
+
+// Return the length of the run of PATHUTILS_BYTECLASS_PLAIN bytes starting at `p`, not looking beyond `end`.
+// These 'plain-as-Jim vanilla' bytes are always passed through as-is, no matter where they occur in a path: [A-Za-z0-9_()].
+//
+// The vectorized versions test 32 (AVX2) or 16 (SSE2) bytes at a time for [0-9], [a-zA-Z] (after folding to lower case),
+// '_', '(' and ')'; all bytes >= 0x80 are negative in a signed compare and thus never end up in any of those ranges.
+static size_t fz_sanitize_plain_run_length(const char* p, const char* end)
+{
+	const char* s = p;
+
+#if defined(FZ_SANITIZE_HAS_AVX2)
+	const __m256i lo_digit = _mm256_set1_epi8('0' - 1);
+	const __m256i hi_digit = _mm256_set1_epi8('9' + 1);
+	const __m256i lo_alpha = _mm256_set1_epi8('a' - 1);
+	const __m256i hi_alpha = _mm256_set1_epi8('z' + 1);
+	const __m256i case_bit = _mm256_set1_epi8(0x20);
+	const __m256i underscore = _mm256_set1_epi8('_');
+	const __m256i lparen = _mm256_set1_epi8('(');
+	const __m256i rparen = _mm256_set1_epi8(')');
+
+	while (end - p >= 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i lc = _mm256_or_si256(v, case_bit);
+		__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo_digit), _mm256_cmpgt_epi8(hi_digit, v));
+		__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lc, lo_alpha), _mm256_cmpgt_epi8(hi_alpha, lc));
+		__m256i other = _mm256_or_si256(_mm256_cmpeq_epi8(v, underscore), _mm256_or_si256(_mm256_cmpeq_epi8(v, lparen), _mm256_cmpeq_epi8(v, rparen)));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(digit, alpha), other));
+		if (mask != 0xFFFFFFFFU)
+			return (p - s) + fz_count_trailing_zeros(~mask);
+		p += 32;
+	}
+#elif defined(FZ_SANITIZE_HAS_SSE2)
+	const __m128i lo_digit = _mm_set1_epi8('0' - 1);
+	const __m128i hi_digit = _mm_set1_epi8('9' + 1);
+	const __m128i lo_alpha = _mm_set1_epi8('a' - 1);
+	const __m128i hi_alpha = _mm_set1_epi8('z' + 1);
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	const __m128i underscore = _mm_set1_epi8('_');
+	const __m128i lparen = _mm_set1_epi8('(');
+	const __m128i rparen = _mm_set1_epi8(')');
+
+	while (end - p >= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i lc = _mm_or_si128(v, case_bit);
+		__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, lo_digit), _mm_cmpgt_epi8(hi_digit, v));
+		__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lc, lo_alpha), _mm_cmpgt_epi8(hi_alpha, lc));
+		__m128i other = _mm_or_si128(_mm_cmpeq_epi8(v, underscore), _mm_or_si128(_mm_cmpeq_epi8(v, lparen), _mm_cmpeq_epi8(v, rparen)));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(digit, alpha), other));
+		if (mask != 0xFFFFU)
+			return (p - s) + fz_count_trailing_zeros(~mask);
+		p += 16;
+	}
+#endif
+
+	// scalar fallback & tail:
+	while (p < end && pathutils_byte_is(*p, PATHUTILS_BYTECLASS_PLAIN))
+		p++;
+	return p - s;
 }
 
-static int has_basename(const char* s, const char* prefix)
+// Vectorized UTF-8 validation, after the lookup-table algorithm by John Keiser and Daniel Lemire ("Validating UTF-8
+// in less than one instruction per byte", as used in simdjson/simdutf).
+//
+// Every error in a UTF-8 stream shows up in the (previous byte, current byte) pair, apart from too long/too short
+// multi-byte sequences, which show up in the bytes 2 and 3 positions earlier. The first class is caught by three
+// 16-entry table lookups (high nibble of the previous byte, low nibble of the previous byte, high nibble of the
+// current byte), each producing a bitmask of the errors that are possible given that nibble; any bit surviving
+// the AND of all three is an actual error. The second class is found by checking that exactly the bytes
+// following a 3- or 4-byte lead are continuation bytes.
+#if defined(FZ_SANITIZE_HAS_AVX2) || (defined(FZ_SANITIZE_HAS_SSE2) && (defined(__SSSE3__) || defined(__AVX__)))
+#define FZ_SANITIZE_HAS_UTF8_SIMD    1
+
+#if !defined(FZ_SANITIZE_HAS_AVX2)
+#include <tmmintrin.h>
+#endif
+
+#define FZ_UTF8_TOO_SHORT         (1 << 0)    // lead byte not followed by (enough) continuation bytes
+#define FZ_UTF8_TOO_LONG          (1 << 1)    // ASCII followed by a continuation byte
+#define FZ_UTF8_OVERLONG_3        (1 << 2)    // E0 80..9F
+#define FZ_UTF8_TOO_LARGE         (1 << 3)    // F4 90..BF, F5..FF
+#define FZ_UTF8_SURROGATE         (1 << 4)    // ED A0..BF
+#define FZ_UTF8_OVERLONG_2        (1 << 5)    // C0, C1
+#define FZ_UTF8_TOO_LARGE_1000    (1 << 6)    // F5..FF 80..8F
+#define FZ_UTF8_OVERLONG_4        (1 << 6)    // F0 80..8F
+#define FZ_UTF8_TWO_CONTS         (1 << 7)    // two continuation bytes in a row: only legal after a 3/4-byte lead
+#define FZ_UTF8_CARRY             (FZ_UTF8_TOO_SHORT | FZ_UTF8_TOO_LONG | FZ_UTF8_TWO_CONTS)
+
+#define FZ_UTF8_BYTE_1_HIGH_TABLE \
+	FZ_UTF8_TOO_LONG, FZ_UTF8_TOO_LONG, FZ_UTF8_TOO_LONG, FZ_UTF8_TOO_LONG, \
+	FZ_UTF8_TOO_LONG, FZ_UTF8_TOO_LONG, FZ_UTF8_TOO_LONG, FZ_UTF8_TOO_LONG, \
+	FZ_UTF8_TWO_CONTS, FZ_UTF8_TWO_CONTS, FZ_UTF8_TWO_CONTS, FZ_UTF8_TWO_CONTS, \
+	FZ_UTF8_TOO_SHORT | FZ_UTF8_OVERLONG_2, \
+	FZ_UTF8_TOO_SHORT, \
+	FZ_UTF8_TOO_SHORT | FZ_UTF8_OVERLONG_3 | FZ_UTF8_SURROGATE, \
+	FZ_UTF8_TOO_SHORT | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000 | FZ_UTF8_OVERLONG_4
+
+#define FZ_UTF8_BYTE_1_LOW_TABLE \
+	FZ_UTF8_CARRY | FZ_UTF8_OVERLONG_3 | FZ_UTF8_OVERLONG_2 | FZ_UTF8_OVERLONG_4, \
+	FZ_UTF8_CARRY | FZ_UTF8_OVERLONG_2, \
+	FZ_UTF8_CARRY, \
+	FZ_UTF8_CARRY, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000 | FZ_UTF8_SURROGATE, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000, \
+	FZ_UTF8_CARRY | FZ_UTF8_TOO_LARGE | FZ_UTF8_TOO_LARGE_1000
+
+#define FZ_UTF8_BYTE_2_HIGH_TABLE \
+	FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, \
+	FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, \
+	FZ_UTF8_TOO_LONG | FZ_UTF8_OVERLONG_2 | FZ_UTF8_TWO_CONTS | FZ_UTF8_OVERLONG_3 | FZ_UTF8_TOO_LARGE_1000 | FZ_UTF8_OVERLONG_4, \
+	FZ_UTF8_TOO_LONG | FZ_UTF8_OVERLONG_2 | FZ_UTF8_TWO_CONTS | FZ_UTF8_OVERLONG_3 | FZ_UTF8_TOO_LARGE, \
+	FZ_UTF8_TOO_LONG | FZ_UTF8_OVERLONG_2 | FZ_UTF8_TWO_CONTS | FZ_UTF8_SURROGATE | FZ_UTF8_TOO_LARGE, \
+	FZ_UTF8_TOO_LONG | FZ_UTF8_OVERLONG_2 | FZ_UTF8_TWO_CONTS | FZ_UTF8_SURROGATE | FZ_UTF8_TOO_LARGE, \
+	FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT, FZ_UTF8_TOO_SHORT
+
+#if defined(FZ_SANITIZE_HAS_AVX2)
+#define FZ_UTF8_BLOCK_SIZE    32
+
+// Return the error bits for the 32-byte block `input`, given the previous block `prev_input`.
+static inline __m256i fz_utf8_check_block(__m256i input, __m256i prev_input)
 {
-	size_t len = strlen(prefix);
-	return (fz_strncasecmp(s, prefix, len) == 0) &&
-		(!s[len] || s[len] == '.');
+	const __m256i byte_1_high = _mm256_setr_epi8(FZ_UTF8_BYTE_1_HIGH_TABLE, FZ_UTF8_BYTE_1_HIGH_TABLE);
+	const __m256i byte_1_low = _mm256_setr_epi8(FZ_UTF8_BYTE_1_LOW_TABLE, FZ_UTF8_BYTE_1_LOW_TABLE);
+	const __m256i byte_2_high = _mm256_setr_epi8(FZ_UTF8_BYTE_2_HIGH_TABLE, FZ_UTF8_BYTE_2_HIGH_TABLE);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+	// the bytes 1, 2 and 3 positions earlier; _mm256_alignr_epi8() works per 128-bit lane, hence the permute.
+	__m256i carried = _mm256_permute2x128_si256(prev_input, input, 0x21);
+	__m256i prev1 = _mm256_alignr_epi8(input, carried, 16 - 1);
+	__m256i prev2 = _mm256_alignr_epi8(input, carried, 16 - 2);
+	__m256i prev3 = _mm256_alignr_epi8(input, carried, 16 - 3);
+
+	__m256i sc = _mm256_and_si256(
+		_mm256_and_si256(
+			_mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+			_mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+		_mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+	// only 111xxxxx (3-byte lead) two bytes back, or 1111xxxx (4-byte lead) three bytes back end up >= 0x80 here:
+	__m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+	__m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+	__m256i must23 = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char)0x80));
+
+	return _mm256_xor_si256(must23, sc);
 }
 
-static int has_infix(const char* s, const char* infix)
+// Return TRUE when the `len` bytes at `s` form a complete, well-formed UTF-8 sequence: no overlong encodings,
+// no surrogates, nothing beyond U+10FFFF and no truncated sequence at the end.
+static int fz_utf8_is_valid(const char* s, size_t len)
 {
-	size_t len = strlen(infix);
-	size_t slen = strlen(s);
-	if (slen < len)
-		return 0;
-	for (size_t i = 0; i < slen - len; i++)
+	__m256i prev_input = _mm256_setzero_si256();
+	__m256i error = _mm256_setzero_si256();
+
+	for (; len >= FZ_UTF8_BLOCK_SIZE; s += FZ_UTF8_BLOCK_SIZE, len -= FZ_UTF8_BLOCK_SIZE)
 	{
-		if (has_prefix(s + i, infix))
-			return 1;
+		__m256i input = _mm256_loadu_si256((const __m256i*)s);
+		error = _mm256_or_si256(error, fz_utf8_check_block(input, prev_input));
+		prev_input = input;
 	}
-	return 0;
+
+	// the zero-padded tail block also flags any sequence left incomplete at the end of the input.
+	unsigned char tail[FZ_UTF8_BLOCK_SIZE] = { 0 };
+	memcpy(tail, s, len);
+	error = _mm256_or_si256(error, fz_utf8_check_block(_mm256_loadu_si256((const __m256i*)tail), prev_input));
+
+	return _mm256_testz_si256(error, error);
+}
+
+#else
+#define FZ_UTF8_BLOCK_SIZE    16
+
+// Return the error bits for the 16-byte block `input`, given the previous block `prev_input`.
+static inline __m128i fz_utf8_check_block(__m128i input, __m128i prev_input)
+{
+	const __m128i byte_1_high = _mm_setr_epi8(FZ_UTF8_BYTE_1_HIGH_TABLE);
+	const __m128i byte_1_low = _mm_setr_epi8(FZ_UTF8_BYTE_1_LOW_TABLE);
+	const __m128i byte_2_high = _mm_setr_epi8(FZ_UTF8_BYTE_2_HIGH_TABLE);
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+
+	__m128i prev1 = _mm_alignr_epi8(input, prev_input, 16 - 1);
+	__m128i prev2 = _mm_alignr_epi8(input, prev_input, 16 - 2);
+	__m128i prev3 = _mm_alignr_epi8(input, prev_input, 16 - 3);
+
+	__m128i sc = _mm_and_si128(
+		_mm_and_si128(
+			_mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+			_mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+		_mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+	__m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+	__m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+	__m128i must23 = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8((char)0x80));
+
+	return _mm_xor_si128(must23, sc);
 }
 
+// Return TRUE when the `len` bytes at `s` form a complete, well-formed UTF-8 sequence: no overlong encodings,
+// no surrogates, nothing beyond U+10FFFF and no truncated sequence at the end.
+static int fz_utf8_is_valid(const char* s, size_t len)
+{
+	__m128i prev_input = _mm_setzero_si128();
+	__m128i error = _mm_setzero_si128();
+
+	for (; len >= FZ_UTF8_BLOCK_SIZE; s += FZ_UTF8_BLOCK_SIZE, len -= FZ_UTF8_BLOCK_SIZE)
+	{
+		__m128i input = _mm_loadu_si128((const __m128i*)s);
+		error = _mm_or_si128(error, fz_utf8_check_block(input, prev_input));
+		prev_input = input;
+	}
+
+	// the zero-padded tail block also flags any sequence left incomplete at the end of the input.
+	unsigned char tail[FZ_UTF8_BLOCK_SIZE] = { 0 };
+	memcpy(tail, s, len);
+	error = _mm_or_si128(error, fz_utf8_check_block(_mm_loadu_si128((const __m128i*)tail), prev_input));
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
 
+// Return the length of the run of non-ASCII bytes (>= 0x80) starting at `p`, not looking beyond `end`.
+// As these all have their top bit set, a plain movemask tells us where the run ends.
+static size_t fz_sanitize_high_run_length(const char* p, const char* end)
+{
+	const char* s = p;
+
+#if defined(FZ_SANITIZE_HAS_AVX2)
+	while (end - p >= 32)
+	{
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)p));
+		if (mask != 0xFFFFFFFFU)
+			return (p - s) + fz_count_trailing_zeros(~mask);
+		p += 32;
+	}
+#else
+	while (end - p >= 16)
+	{
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+		if (mask != 0xFFFFU)
+			return (p - s) + fz_count_trailing_zeros(~mask);
+		p += 16;
+	}
+#endif
+
+	while (p < end && (*p & 0x80))
+		p++;
+	return p - s;
+}
+#endif
 
 // Detect 'reserved' and other 'dangerous' file/directory names.
 //
@@ -288,61 +582,27 @@ static int has_infix(const char* s, const char* infix)
 //   however I tested it on my own GoogleDrive account and at the time of this writing (May 2023) 
 //   Google didn't object to creating a tree depth >= 32, nor a filename <= 500 characters.)
 //
-static int is_reserved_filename(const char* s)
+// Return TRUE when the path segment of `len` bytes at `s` is a reserved or otherwise 'dangerous' file/directory name.
+static int is_reserved_filename(const char* s, size_t len)
 {
-	if (has_infix(s, "_vti_"))
-		return 1;
-	if (has_postfix(s, "$"))
-		return 1;
-	if (has_postfix(s, "~"))
-		return 1;
-
-	switch (tolower(s[0]))
-	{
-	case 'a':
-		return has_basename(s, "aux");
-
-	case 'd':
-		return has_basename(s, "dev") ||
-			has_prefix(s, "desktop.ini");
-
-	case 'c':
-		return has_basename(s, "con") ||
-			(has_prefix(s, "com") && isdigit(s[3]));
-
-	case 'l':
-		return has_prefix(s, "lpt") && isdigit(s[3]);
-
-	case 'n':
-		return has_basename(s, "nul") ||
-			has_basename(s, "null");
-
-	case 'p':
-		return has_basename(s, "prn");
-
-	case 's':
-		return has_basename(s, "stdin") ||
-			has_basename(s, "stdout") ||
-			has_basename(s, "stderr");
-
-	case '_':
-		return has_basename(s, "__macosx");
+	if (len == 0)
+		return 0;
 
-	case '~':
+	if (s[0] == '~' || s[0] == '$' || s[0] == '-')
 		return 1;
-
-	case '.':
-		return has_basename(s + 1, "lock");
-		has_basename(s + 1, "ds_store");
-
-	case '$':
+	if (s[len - 1] == '$' || s[len - 1] == '~')
+		return 1;
+	if (has_infix(s, len, "_vti_"))
 		return 1;
 
-	case '-':
+	// MSDOS/Windows devices, with or without extension:
+	size_t device_len;
+	if (pathutils_match_dos_device(s, len, &device_len) != PATHUTILS_DOS_DEVICE_NONE &&
+		(device_len == len || s[device_len] == '.'))
 		return 1;
-	}
 
-	return 0;
+	// UNIX devices, Mac/OSX and OneDrive names, see reserved-names.cpp:
+	return pathutils_match_reserved_name(s, len);
 }
 
 const char* rigorously_clean_fname(char* s)
@@ -350,15 +610,16 @@ const char* rigorously_clean_fname(char* s)
 	// - keep up to two 'extension' dots.
 	// - nuke anything that's not an ASCII alphanumeric
 	// - modify in place
+	char* start = s;
 	char* d = s;
 	while (*s)
 	{
-		char c = *s;
-		if (isalnum(c))
+		char c = *s++;
+		if (isalnum((unsigned char)c))
 		{
 			*d++ = c;
 		}
-		else if (c == '.' && d > s)
+		else if (c == '.' && d > start)
 		{
 			*d++ = c;
 		}
@@ -366,14 +627,14 @@ const char* rigorously_clean_fname(char* s)
 	}
 
 	// trim off trailing dots:
-	while (d > s && d[1] == '.')
+	while (d > start && d[-1] == '.')
 		d--;
 
 	*d = 0;
 
 	// now nuke all but the last two dots:
 	int dot_count = 0;
-	while (d > s)
+	while (d > start)
 	{
 		char c = *--d;
 		if (c == '.')
@@ -384,10 +645,13 @@ const char* rigorously_clean_fname(char* s)
 		}
 	}
 
-	return d;
+	return start;
 }
 
 
+// The policy used when no custom replacements have been specified: it replaces nothing.
+static const pathutils_sanitize_policy fz_sanitize_default_policy = { { 0 } };
+
 /**
  * Sanitize a given path, i.e. replace any "illegal" characters in the path, using generic
  * OS/filesystem heuristics. "Illegal" characters are replaced with an _ underscore.
@@ -432,7 +696,7 @@ int fz_sanitize_path(fz_context* ctx, char* dstpath, size_t dstpath_bufsize, con
 		len = strlen(dstpath);
 	}
 
-	return fz_sanitize_path_ex(dstpath, NULL, NULL, 0, dstpath_bufsize);
+	return fz_sanitize_path_with_policy(dstpath, &fz_sanitize_default_policy, 0, dstpath_bufsize);
 }
 
 
@@ -459,6 +723,12 @@ int fz_sanitize_path(fz_context* ctx, char* dstpath, size_t dstpath_bufsize, con
 	`start_at_offset` position is sanitized. It is assumed that the non-zero offset ALWAYS points past any critical
 	UNC or MSWindows Drive designation parts of the path.
 
+	Reserved and overlong path segments are renamed to `_H<hash>_...`, where the hash is calculated over the path
+	as cleaned up to and including the first such segment, plus the untouched remainder of the path
+	(PATHUTILS_SANITIZE_HASH_FULL_PATH). That equals the original path only as long as nothing had to be replaced
+	before that segment. Use pathutils_compile_sanitize_policy() and fz_sanitize_path_with_policy() to select
+	another hash mode.
+
 	Modifies the `path` string in place.
 
 		Returns 0 when no sanitization has taken place. Returns 1 when only the filename part
@@ -470,30 +740,84 @@ int fz_sanitize_path(fz_context* ctx, char* dstpath, size_t dstpath_bufsize, con
 int
 fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, size_t start_at_offset, size_t maximum_path_length)
 {
-	if (!path)
-		return 0;
+	if (!set || !*set)
+		return fz_sanitize_path_with_policy(path, &fz_sanitize_default_policy, start_at_offset, maximum_path_length);
+
+	pathutils_sanitize_policy policy;
+	pathutils_compile_sanitize_policy(&policy, set, replace_single, PATHUTILS_SANITIZE_HASH_FULL_PATH);
+	return fz_sanitize_path_with_policy(path, &policy, start_at_offset, maximum_path_length);
+}
+
+
+/**
+	Compile the `set` and `replace_single` arguments of fz_sanitize_path_ex() into a replacement policy,
+	which can be passed to fz_sanitize_path_with_policy() any number of times.
+
+	See fz_sanitize_path_ex() for the meaning of `set` and `replace_single`.
+
+	`hash_mode` (PATHUTILS_SANITIZE_HASH_*) selects what the hash in the name of a renamed path segment is
+	calculated over; fz_sanitize_path_ex() uses PATHUTILS_SANITIZE_HASH_FULL_PATH.
+*/
+void
+pathutils_compile_sanitize_policy(pathutils_sanitize_policy* policy, const char* set, const char* replace_single, int hash_mode)
+{
+	memset(policy, 0, sizeof(*policy));
+	policy->hash_mode = hash_mode;
+
 	if (!replace_single || !*replace_single)
 		replace_single = "_";
 	if (!set)
 		set = "";
 
 	size_t repl_map_len = strlen(replace_single);
-	int has_printf_format_repl_idx1;
+
+	for (size_t idx = 0; set[idx]; idx++)
 	{
-		const char* m = strchr(set, 'f');
-		if (m)
-		{
-			has_printf_format_repl_idx1 = m - set;
-			// pick last in map when we're out-of-bounds:
-			if (has_printf_format_repl_idx1 >= repl_map_len)
-				has_printf_format_repl_idx1 = repl_map_len - 1;
-			has_printf_format_repl_idx1++;
-		}
-		else
-		{
-			has_printf_format_repl_idx1 = 0;
-		}
+		unsigned char c = set[idx];
+
+		// pick last in map when we're out-of-bounds:
+		char r = replace_single[idx < repl_map_len ? idx : repl_map_len - 1];
+
+		// custom replacement for fz_format / printf formatters:
+		if (c == 'f' && !policy->printf_format_replacement)
+			policy->printf_format_replacement = r;
+
+		// the first occurrence in the set determines the replacement:
+		if (!policy->replacement[c])
+			policy->replacement[c] = r;
+
+		// the plain bytes fast path can only be used when none of those bytes are part of the custom `set`:
+		if (pathutils_byte_is(c, PATHUTILS_BYTECLASS_PLAIN))
+			policy->has_plain_bytes = 1;
+
+		// ditto for the validated UTF-8 fast path and the bytes >= 0x80:
+		if (pathutils_byte_is(c, PATHUTILS_BYTECLASS_HIGH))
+			policy->has_high_bytes = 1;
 	}
+}
+
+
+/**
+	Identical to fz_sanitize_path_ex(), but takes a precompiled replacement policy instead of the
+	`set` and `replace_single` arguments, so that repeated callers don't pay for decoding those
+	on every call.
+
+	`policy` may be NULL, in which case no custom replacements are performed.
+*/
+int
+fz_sanitize_path_with_policy(char* path, const pathutils_sanitize_policy* policy, size_t start_at_offset, size_t maximum_path_length)
+{
+	if (!path)
+		return 0;
+	if (!policy)
+		policy = &fz_sanitize_default_policy;
+
+	int use_plain_fast_path = !policy->has_plain_bytes;
+#if defined(FZ_SANITIZE_HAS_UTF8_SIMD)
+	int use_utf8_fast_path = !policy->has_high_bytes;
+	// end of the last non-ASCII run which failed validation: we don't re-validate (the tail of) that one.
+	const char* utf8_unproven_end = path;
+#endif
 
 	if (start_at_offset)
 	{
@@ -526,7 +850,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 		// check if path is a UNC path. It may legally start with `\\.\` or `\\?\` before a Windows drive/share+COLON:
 		if (e[0] == '/' && e[1] == '/')
 		{
-			if (strchr(".?", e[2]) != NULL && e[3] == '/')
+			if (e[2] && strchr(".?", e[2]) != NULL && e[3] == '/')
 			{
 				// skip //?/ and //./ UNC path leaders
 				e += 4;
@@ -536,7 +860,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 			{
 				// skip //<server>... UNC path starter (which cannot contain Windows drive letters as-is)
 				char* p = e + 2;
-				while (isalnum(*p) || strchr("_-$", *p))
+				while (isalnum(*p) || (*p && strchr("_-$", *p)))
 					p++;
 				if (p > e && *p == '/' && p[1] != '/')
 					p++;
@@ -618,10 +942,13 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 	while (e[0] == '/')
 		e++;
 
-	// calculate a simple & fast hash of the remaining path:
-	uint32_t hash = calchash(e);
+	// a simple & fast hash of the path, which is only calculated once we have a segment to rename: see below.
+	uint32_t hash = 0;
+	int have_hash = 0;
 
 	char* p = e;
+	// `d` never runs ahead of `p`, so the end of the input stays put while we clean the path in place:
+	const char* p_end = p + strlen(p);
 
 	// now go and scan/clean the rest of the path spec:
 	int repl_seq_count = 0;
@@ -640,11 +967,40 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 		// we don't have to bother the rest of the code/loop with this,
 		// making the code easier to review. Performance is still good enough.
 
+		// fast path: the bulk of any path is plain alphanumerics, which we can pass through as-is,
+		// so only the bytes which need a decision make it to the state machine below.
+		if (use_plain_fast_path && pathutils_byte_is(*p, PATHUTILS_BYTECLASS_PLAIN))
+		{
+			size_t n = fz_sanitize_plain_run_length(p, p_end);
+			if (d != p)
+				memmove(d, p, n);
+			d += n;
+			p += n;
+			repl_seq_count = 0;
+			continue;
+		}
+
 		char c = *p++;
 		if (c == '/')
 		{
 			*d = 0;
-			if (is_reserved_filename(cur_segment_start))
+			int is_reserved = is_reserved_filename(cur_segment_start, d - cur_segment_start);
+			if ((is_reserved || d - cur_segment_start > 255) && (!have_hash || policy->hash_mode == PATHUTILS_SANITIZE_HASH_SEGMENT_PREFIX))
+			{
+				// hash the path as cleaned so far, i.e. up to and including this segment, and, unless we're
+				// hashing per segment, the remainder of the path, which is still untouched.
+				// (As long as we didn't have to replace anything, that's the original path.)
+				uint64_t x = calchash_feed(CALCHASH_SEED, e_start, d);
+				if (policy->hash_mode != PATHUTILS_SANITIZE_HASH_SEGMENT_PREFIX)
+				{
+					x = calchash_feed(x, &c, &c + 1);
+					x = calchash_feed(x, p, p_end);
+				}
+				hash = calchash_finish(x);
+				have_hash = 1;
+			}
+
+			if (is_reserved)
 			{
 				// previous part of the path isn't allowed: replace by a hash-based name instead.
 				char buf[32];
@@ -655,7 +1011,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 
 				int rslen = max_width;
 				rslen -= 4 + 8;
-				if (rslen > fnlen)
+				if (rslen > (int)fnlen)
 					rslen = fnlen;
 
 				if (rslen >= 0)
@@ -684,7 +1040,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 					size_t fnlen = strlen(old_cleaned_fname);
 
 					int rslen = 255 - 10;
-					if (rslen > fnlen)
+					if (rslen > (int)fnlen)
 						rslen = fnlen;
 
 					snprintf(buf, sizeof(buf), "_H%08X_%s", (unsigned int)hash, old_cleaned_fname + fnlen - rslen);
@@ -708,7 +1064,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 		}
 
 		// custom set replacements for printf-style format bits, anyone?
-		if (has_printf_format_repl_idx1 && c == '%')
+		if (policy->printf_format_replacement && c == '%')
 		{
 			// replace any %[+/-/ ][0-9.*][dlfgespuizxc] with a single replacement character
 			while (*p && strchr("+- .0123456789*", *p))
@@ -719,14 +1075,14 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 				p++;
 
 			// custom 1:1 replacement: set -> replace_single.
-			*d++ = replace_single[has_printf_format_repl_idx1 - 1];
+			*d++ = policy->printf_format_replacement;
 			repl_seq_count++;
 			continue;
 		}
 
 		// custom set replacements, anyone?
-		const char* m = strchr(set, c);
-		if (m)
+		char r = policy->replacement[(unsigned char)c];
+		if (r)
 		{
 			// custom replacement for fz_format / printf formatters:
 			if (c == '#')
@@ -737,11 +1093,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 			}
 
 			// custom 1:1 replacement: set -> replace_single.
-			int idx = m - set;
-			// pick last in map when we're out-of-bounds:
-			if (idx >= repl_map_len)
-				idx = repl_map_len - 1;
-			*d++ = replace_single[idx];
+			*d++ = r;
 			repl_seq_count++;
 			continue;
 		}
@@ -754,6 +1106,76 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 		// in fact, check for *proper UTF8 encoding* and replace all illegal code points:
 		if (c > 0x7F || c < 0) {
 			// 0x80 and higher character codes: UTF8
+#if defined(FZ_SANITIZE_HAS_UTF8_SIMD)
+			// fast path: prove the entire run of non-ASCII bytes is well-formed UTF-8 in one go, after which
+			// we can decode its codepoints without any further checks and only need to check their legality.
+			// (CJK and Cyrillic file names consist largely of such runs.)
+			if (use_utf8_fast_path && p - 1 >= utf8_unproven_end)
+			{
+				const char* run = p - 1;
+				size_t n = fz_sanitize_high_run_length(run, p_end);
+				const char* run_end = run + n;
+
+				if (n >= 4 && fz_utf8_is_valid(run, n))
+				{
+					p = (char*)run;
+					while (p < run_end)
+					{
+						while (repl_seq_count > 1)
+						{
+							if (d[-1] != d[-2])
+								break;
+							d--;
+							repl_seq_count--;
+						}
+
+						const unsigned char* s = (const unsigned char*)p;
+						int u;
+						int l;
+						if (s[0] < 0xE0)
+						{
+							u = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+							l = 2;
+						}
+						else if (s[0] < 0xF0)
+						{
+							u = ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+							l = 3;
+							// a well-formed U+FFFD is rejected as Runeerror byte by byte: leave that to the slow path below.
+							if (u == Runeerror)
+							{
+								utf8_unproven_end = run_end;
+								break;
+							}
+						}
+						else
+						{
+							u = ((s[0] & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+							l = 4;
+						}
+
+						if (fz_is_legal_codepoint(u))
+						{
+							// Unicode: L (Letter) or N (Number)
+							// --> keep Unicode UTF8 codepoint:
+							for (; l > 0; l--)
+								*d++ = *p++;
+							repl_seq_count = 0;
+						}
+						else
+						{
+							// undesirable UTF8 codepoint is to be discarded!
+							*d++ = '_';
+							p += l;
+							repl_seq_count++;
+						}
+					}
+					continue;
+				}
+
+				utf8_unproven_end = run_end;
+			}
+#endif
 			int u;
 			int l = fz_chartorune_unsafe(&u, p - 1);
 			if (u == Runeerror) {
@@ -763,22 +1185,16 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 				continue;
 			}
 
-			// Only accept Letters and Numbers in the BMP:
-			if (u <= 65535)
+			// Only accept Letters and Numbers:
+			if (fz_is_legal_codepoint(u))
 			{
-				int pos = u / 32;
-				int bit = u % 32;
-				uint32_t mask = 1U << bit;
-				if (legal_codepoints_bitmask[pos] & mask)
-				{
-					// Unicode BMP: L (Letter) or N (Number)
-					// --> keep Unicode UTF8 codepoint:
-					p--;
-					for (; l > 0; l--)
-						*d++ = *p++;
-					repl_seq_count = 0;
-					continue;
-				}
+				// Unicode: L (Letter) or N (Number)
+				// --> keep Unicode UTF8 codepoint:
+				p--;
+				for (; l > 0; l--)
+					*d++ = *p++;
+				repl_seq_count = 0;
+				continue;
 			}
 
 			// undesirable UTF8 codepoint is to be discarded!
@@ -787,14 +1203,9 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 			repl_seq_count++;
 			continue;
 		}
-		else if (c < ' ' || c == 0x7F /* DEL */)
-		{
-			*d++ = '_';
-			repl_seq_count++;
-			continue;
-		}
-		else if (strchr("`\"*@=|;?:", c))
+		else if (pathutils_byte_is(c, PATHUTILS_BYTEPROFILE_FZ))
 		{
+			// replace ASCII control characters.
 			// replace NTFS-illegal character path characters.
 			// replace some shell-scripting-risky character path characters.
 			// replace the usual *wildcards* as well.
@@ -804,14 +1215,10 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 		}
 		else
 		{
-			static const char* braces = "{}[]<>";
-			const char* b = strchr(braces, c);
-
-			if (b)
+			if (pathutils_byte_is(c, PATHUTILS_BYTECLASS_BRACE_OPEN | PATHUTILS_BYTECLASS_BRACE_CLOSE))
 			{
 				// replace some shell-scripting-risky brace types as well: all braces are transmuted to `()` for safety.
-				int idx = b - braces;
-				*d++ = "()"[idx % 2];
+				*d++ = (pathutils_byte_is(c, PATHUTILS_BYTECLASS_BRACE_OPEN) ? '(' : ')');
 				repl_seq_count++;
 				continue;
 			}
@@ -855,7 +1262,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 				repl_seq_count = 0;
 				continue;
 			}
-			else if (isalnum(c))
+			else if (pathutils_byte_is(c, PATHUTILS_BYTECLASS_ALNUM))
 			{
 				// we're looking at a plain-as-Jim vanilla character here: pass as-is:
 				*d++ = c;
@@ -889,7 +1296,7 @@ fz_sanitize_path_ex(char* path, const char* set, const char* replace_single, siz
 				repl_seq_count = 0;
 				continue;
 			}
-			else if (strchr("_()", c))
+			else if (pathutils_byte_is(c, PATHUTILS_BYTECLASS_PLAIN))
 			{
 				// we're looking at a plain-as-Jim vanilla character here: pass as-is:
 				*d++ = c;
@@ -1164,6 +1571,165 @@ int fz_chdir(fz_context* ctx, const char* path)
 	return 0;
 }
 
+#if !defined(_WIN32)
+
+#define FZ_MKDIR_MODE    (S_IRWXU | S_IRWXG | S_IRWXO)
+
+// Return the first of the run of '/' separators before the last path element ending at `end`, or NULL when that element
+// is the first one in `path`, i.e. when its parent is the current directory or the (UNIX, MSDOS or network) root.
+static char* fz_mkdirp_parent_separator(char* path, char* end)
+{
+	char* sep = end;
+	while (sep > path && sep[-1] != '/')
+		sep--;
+	if (sep == path)
+		return NULL;
+	sep--;
+	while (sep > path && sep[-1] == '/')
+		sep--;
+	if (sep == path || sep[-1] == ':')
+		return NULL;
+	return sep;
+}
+
+// mkdir() reports EEXIST for any kind of file, so before a name which it reported to exist goes into the known directories
+// cache, check that it's a directory.
+static int fz_mkdirp_is_dir_at(int dirfd, const char* name)
+{
+	struct stat st;
+	int e = errno;
+	int rv = (fstatat(dirfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+	errno = e;
+	return rv;
+}
+
+// Create directory `path` plus any missing parents, leaf first.
+//
+// Creating every ancestor from the root down costs one mkdir() per path level, even when all of them already exist.
+// Instead we first try the leaf itself: when it exists (or only the leaf was missing), that's the only syscall.
+// Only on ENOENT do we back off towards the root until we hit an ancestor which exists, then create the missing
+// directories forward from there with mkdirat(), relative to the open parent, so the kernel does not need to walk
+// the (long) path prefix again for every level.
+//
+// With a `known` directories cache (see known-dirs.cpp), directories which it knows about cost no syscall at all,
+// and every directory we create or find to exist is added to it (provided its path is absolute, see known-dirs.cpp).
+//
+// `path` is modified during the process, but restored before we return. Returns 0 on success, -1 plus errno on error.
+static int fz_mkdirp_leaf_first(char* path, pathutils_known_dirs* known)
+{
+	size_t len = strlen(path);
+	while (len > 1 && path[len - 1] == '/')
+		len--;
+	// do not mkdir the UNIX or MSDOS/WIN/Network root directory:
+	if (len == 0 || path[len - 1] == ':')
+		return 0;
+	if (known && pathutils_known_dirs_contains(known, path, len))
+		return 0;
+	char* path_end = path + len;
+	char c = *path_end;
+	*path_end = 0;
+
+	// the common case: the directory already exists, or only the leaf is missing.
+	int made = (mkdir(path, FZ_MKDIR_MODE) == 0);
+	if (made || errno == EEXIST)
+	{
+		if (known && (made || fz_mkdirp_is_dir_at(AT_FDCWD, path)))
+			pathutils_known_dirs_insert(known, path, len);
+		*path_end = c;
+		return 0;
+	}
+
+	// back off towards the root until we hit an ancestor which exists (or which we've just created):
+	char* end = path_end;
+	int rv = -1;
+	while (errno == ENOENT)
+	{
+		char* sep = fz_mkdirp_parent_separator(path, end);
+		if (!sep)
+			break;
+		*sep = 0;
+		end = sep;
+		// the mkdir() of its child reported ENOENT, so when the cache lists this ancestor, that entry is stale:
+		// the directory was removed behind our back. Forget it and find out the hard way.
+		if (known)
+			pathutils_known_dirs_forget(known, path, end - path);
+		made = (mkdir(path, FZ_MKDIR_MODE) == 0);
+		if (made || errno == EEXIST)
+		{
+			if (known && (made || fz_mkdirp_is_dir_at(AT_FDCWD, path)))
+				pathutils_known_dirs_insert(known, path, end - path);
+			rv = 0;
+			break;
+		}
+		if (errno == EACCES)
+		{
+			rv = 0;
+			break;
+		}
+	}
+
+	int dirfd = -1;
+	if (rv == 0)
+	{
+		dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dirfd < 0)
+			rv = -1;
+	}
+
+	// restore the path separators we've cut:
+	for (char* p = end; p < path_end; p++)
+	{
+		if (!*p)
+			*p = '/';
+	}
+
+	// and create the missing directories, forward from the ancestor:
+	char* name = end;
+	while (rv == 0 && name < path_end)
+	{
+		while (*name == '/')
+			name++;
+		char* e = name;
+		while (e < path_end && *e != '/')
+			e++;
+		char ec = *e;
+		*e = 0;
+
+		made = (mkdirat(dirfd, name, FZ_MKDIR_MODE) == 0);
+		if (!made && errno != EEXIST)
+		{
+			rv = -1;
+		}
+		else
+		{
+			if (known && (made || fz_mkdirp_is_dir_at(dirfd, name)))
+				pathutils_known_dirs_insert(known, path, e - path);
+		}
+		if (rv == 0 && e < path_end)
+		{
+			int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0)
+				rv = -1;
+			close(dirfd);
+			dirfd = fd;
+		}
+
+		*e = ec;
+		name = e;
+	}
+
+	if (dirfd >= 0)
+	{
+		int e = errno;
+		close(dirfd);
+		errno = e;
+	}
+	*path_end = c;
+	return rv;
+}
+
+#endif
+
 void fz_mkdir_for_file(fz_context* ctx, const char* path)
 {
 #if defined(_WIN32)
@@ -1215,30 +1781,14 @@ void fz_mkdir_for_file(fz_context* ctx, const char* path)
 		// strip off the *filename*: keep the (nested?) path intact for recursive mkdir:
 		*e = 0;
 
-		// construct the path:
-		for (e = strchr(buf, '/'); e; e = strchr(e + 1, '/'))
+		// create the directory and its missing parents, if any:
+		if (fz_mkdirp_leaf_first(buf, pathutils_get_known_dirs()))
 		{
-			*e = 0;
-			// do not mkdir UNIX or MSDOS/WIN/Network root directory:
-			if (e == buf || e[-1] == ':' || e[-1] == '/')
-			{
-				*e = '/';
-				continue;
-			}
-			// just bluntly attempt to create the directory: we don't care if it fails.
-			int rv = mkdir(buf);
-			if (rv)
-			{
-				fz_copy_ephemeral_errno(ctx);
-				ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-				rv = fz_ctx_get_rtl_errno(ctx);
-				if (rv != EEXIST)
-				{
-					const char* errmsg = fz_ctx_get_system_errormsg(ctx);
-					fz_info(ctx, "mkdirp --> mkdir(%s) --> (%d) %s\n", buf, rv, errmsg);
-				}
-			}
-			*e = '/';
+			fz_copy_ephemeral_errno(ctx);
+			ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
+			int rv = fz_ctx_get_rtl_errno(ctx);
+			const char* errmsg = fz_ctx_get_system_errormsg(ctx);
+			fz_info(ctx, "mkdirp --> mkdir(%s) --> (%d) %s\n", buf, rv, errmsg);
 		}
 	}
 	fz_free(ctx, buf);
@@ -1246,221 +1796,106 @@ void fz_mkdir_for_file(fz_context* ctx, const char* path)
 }
 
 
-int64_t
-fz_stat_ctime(fz_context* ctx, const char* path)
+int
+fz_stat_info(fz_context* ctx, const char* path, fz_file_info* info, unsigned int mask)
 {
+	if (!mask)
+		mask = FZ_STAT_ALL;
+	memset(info, 0, sizeof(*info));
+
 #if defined(_WIN32)
-	struct _stat info;
+	// one path conversion, one stat: Windows always delivers all fields.
+	struct _stat64 st;
 	wchar_t* wpath = fz_UNC_wfullpath_from_name(ctx, path);
 
 	if (!wpath)
-		return 0;
+		return -1;
 
-	int n = _wstat(wpath, &info);
+	int n = _wstat64(wpath, &st);
 	if (n)
 	{
+		info->error = errno;
 		fz_copy_ephemeral_errno(ctx);
 		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
 		fz_free(ctx, wpath);
-		return 0;
+		return -1;
 	}
 
 	fz_free(ctx, wpath);
-	return info.st_ctime;
+
+	info->valid = FZ_STAT_ALL;
+	info->is_regular_file = (st.st_mode & _S_IFMT) == _S_IFREG;
+	info->is_directory = (st.st_mode & _S_IFMT) == _S_IFDIR;
+	// directories should be reported as size=0 or 1...
+	info->size = info->is_regular_file ? st.st_size : 0;
+	info->atime = st.st_atime;
+	info->mtime = st.st_mtime;
+	info->ctime = st.st_ctime;
+	return 0;
 #else
-	struct stat info;
-	if (stat(path, &info))
+	// see file-stat.cpp
+	if (pathutils_stat_info(path, info, mask))
 	{
 		fz_copy_ephemeral_errno(ctx);
 		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		return 0;
+		return -1;
 	}
-	return info.st_ctime;
+	return 0;
 #endif
 }
 
 int64_t
-fz_stat_mtime(fz_context* ctx, const char* path)
+fz_stat_ctime(fz_context* ctx, const char* path)
 {
-#if defined(_WIN32)
-	struct _stat info;
-	wchar_t* wpath = fz_UNC_wfullpath_from_name(ctx, path);
-
-	if (!wpath)
-		return 0;
-
-	int n = _wstat(wpath, &info);
-	if (n)
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		fz_free(ctx, wpath);
+	fz_file_info info;
+	if (fz_stat_info(ctx, path, &info, FZ_STAT_CTIME))
 		return 0;
-	}
+	return info.ctime;
+}
 
-	fz_free(ctx, wpath);
-	return info.st_mtime;
-#else
-	struct stat info;
-	if (stat(path, &info))
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
+int64_t
+fz_stat_mtime(fz_context* ctx, const char* path)
+{
+	fz_file_info info;
+	if (fz_stat_info(ctx, path, &info, FZ_STAT_MTIME))
 		return 0;
-	}
-	return info.st_mtime;
-#endif
+	return info.mtime;
 }
 
 int64_t
 fz_stat_atime(fz_context* ctx, const char* path)
 {
-#if defined(_WIN32)
-	struct _stat info;
-	wchar_t* wpath = fz_UNC_wfullpath_from_name(ctx, path);
-
-	if (!wpath)
+	fz_file_info info;
+	if (fz_stat_info(ctx, path, &info, FZ_STAT_ATIME))
 		return 0;
-
-	int n = _wstat(wpath, &info);
-	if (n)
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		fz_free(ctx, wpath);
-		return 0;
-	}
-
-	fz_free(ctx, wpath);
-	return info.st_atime;
-#else
-	struct stat info;
-	if (stat(path, &info))
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		return 0;
-	}
-	return info.st_atime;
-#endif
+	return info.atime;
 }
 
 int64_t
 fz_stat_size(fz_context* ctx, const char* path)
 {
-#if defined(_WIN32)
-	struct _stat info;
-	wchar_t* wpath = fz_UNC_wfullpath_from_name(ctx, path);
-
-	if (!wpath)
-		return 0;
-
-	int n = _wstat(wpath, &info);
-	if (n)
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		fz_free(ctx, wpath);
-		return -1;
-	}
-
-	fz_free(ctx, wpath);
-
-	// directories should be reported as size=0 or 1...
-
-	if (info.st_mode & _S_IFDIR)
-		return 0;
-	if (info.st_mode & _S_IFREG)
-		return info.st_size;
-	return 0;
-#else
-	struct stat info;
-	if (stat(path, &info))
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
+	fz_file_info info;
+	if (fz_stat_info(ctx, path, &info, FZ_STAT_SIZE))
 		return -1;
-	}
-	if (info.st_mode & _S_IFDIR)
-		return 0;
-	if (info.st_mode & _S_IFREG)
-		return info.st_size;
-	return 0;
-#endif
+	return info.size;
 }
 
 int
 fz_path_is_regular_file(fz_context* ctx, const char* path)
 {
-#if defined(_WIN32)
-	struct _stat info;
-	wchar_t* wpath = fz_UNC_wfullpath_from_name(ctx, path);
-
-	if (!wpath)
-		return FALSE;
-
-	int n = _wstat(wpath, &info);
-	if (n)
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		fz_free(ctx, wpath);
-		return FALSE;
-	}
-
-	fz_free(ctx, wpath);
-
-	// directories should be reported as size=0 or 1...
-
-	return (info.st_mode & _S_IFREG) && !(info.st_mode & _S_IFDIR);
-#else
-	struct stat info;
-	if (stat(path, &info))
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		return FALSE;
-	}
-
-	return (info.st_mode & _S_IFREG) && !(info.st_mode & _S_IFDIR);
-#endif
+	fz_file_info info;
+	if (fz_stat_info(ctx, path, &info, FZ_STAT_TYPE))
+		return FALSE;
+	return info.is_regular_file;
 }
 
 int
 fz_path_is_directory(fz_context* ctx, const char* path)
 {
-#if defined(_WIN32)
-	struct _stat info;
-	wchar_t* wpath = fz_UNC_wfullpath_from_name(ctx, path);
-
-	if (!wpath)
-		return FALSE;
-
-	int n = _wstat(wpath, &info);
-	if (n)
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-		fz_free(ctx, wpath);
-		return FALSE;
-	}
-
-	fz_free(ctx, wpath);
-
-	// directories should be reported as size=0 or 1...
-
-	return !!(info.st_mode & _S_IFDIR);
-#else
-	struct stat info;
-	if (stat(path, &info))
-	{
-		fz_copy_ephemeral_errno(ctx);
-		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
+	fz_file_info info;
+	if (fz_stat_info(ctx, path, &info, FZ_STAT_TYPE))
 		return FALSE;
-	}
-
-	return !!(info.st_mode & _S_IFDIR);
-#endif
+	return info.is_directory;
 }
 
 
@@ -1568,6 +2003,11 @@ int
 fz_mkdirp_utf8(fz_context* ctx, const char* path)
 {
 #if defined(_WIN32)
+	// see fz_mkdirp_leaf_first() re the known directories cache:
+	pathutils_known_dirs* known = pathutils_get_known_dirs();
+	if (known && pathutils_known_dirs_contains(known, path, strlen(path)))
+		return 0;
+
 	wchar_t* wpath = fz_UNC_wfullpath_from_name(ctx, path);
 
 	if (!wpath)
@@ -1589,31 +2029,56 @@ fz_mkdirp_utf8(fz_context* ctx, const char* path)
 		d = q + wcslen(q);
 	}
 
+	// leaf first, see fz_mkdirp_leaf_first(); there's no mkdirat() here, so the missing directories are created by full path.
 	int rv = 0;
-
-	for (;;)
+	wchar_t* end = wpath + wcslen(wpath);
+	if (_wmkdir(wpath) && errno != EEXIST)
 	{
-		wchar_t c = *d;
-		*d = 0;
-
-		int n = _wmkdir(wpath);
-		int e = errno;
-		if (n && e != EEXIST)
+		// back off towards the first path level until we hit an ancestor which exists:
+		wchar_t* cut = end;
+		int found = 0;
+		while (errno == ENOENT)
+		{
+			wchar_t* sep = cut;
+			while (sep > d && *--sep != L'\\')
+				;
+			if (sep == cut || *sep != L'\\')
+				break;
+			*sep = 0;
+			cut = sep;
+			if (_wmkdir(wpath) == 0 || errno == EEXIST || errno == EACCES)
+			{
+				found = 1;
+				break;
+			}
+		}
+		if (!found)
 		{
 			fz_copy_ephemeral_errno(ctx);
 			ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
 			rv = -1;
 		}
 
-		*d = c;
-		// did we reach the end of the *original* path spec?
-		if (!c)
-			break;
-		q = wcschr(d + 1, '\\');
-		if (q)
-			d = q;
-		else
-			d += wcslen(d);  // make sure the sentinel-patching doesn't damage the last part of the original path spec
+		// restore the path separators we've cut, creating the missing directories on the way:
+		while (cut < end)
+		{
+			*cut = L'\\';
+			cut += wcslen(cut);
+			if (!rv && _wmkdir(wpath) && errno != EEXIST)
+			{
+				fz_copy_ephemeral_errno(ctx);
+				ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
+				rv = -1;
+			}
+		}
+	}
+
+	// _wmkdir() reports EEXIST for files as well: only cache directories.
+	if (!rv && known)
+	{
+		DWORD attrs = GetFileAttributesW(wpath);
+		if (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY))
+			pathutils_known_dirs_insert(known, path, strlen(path));
 	}
 
 	fz_free(ctx, wpath);
@@ -1628,42 +2093,15 @@ fz_mkdirp_utf8(fz_context* ctx, const char* path)
 		return -1;
 	}
 
-	// we can only mkdir beyond the (optional) root directory:
-	char* p = pname + 1;
-	char* d = strchr(p, '/'); // drive rootdir
-	if (d == NULL)
-	{
-		// apparently, there's only one directory name above the drive letter specified. We still need to mkdir that one, though.
-		d = p + strlen(p);
-	}
-
-	for (;;)
+	int rv = fz_mkdirp_leaf_first(pname, pathutils_get_known_dirs());
+	if (rv)
 	{
-		char c = *d;
-		*d = 0;
-
-		int n = mkdir(pname);
-		int e = errno;
-		if (n && e != EEXIST && e != EACCES)
-		{
-			fz_copy_ephemeral_errno(ctx);
-			ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
-			fz_free(ctx, pname);
-			return -1;
-		}
-		*d = c;
-		// did we reach the end of the *original* path spec?
-		if (!c)
-			break;
-		q = strchr(d + 1, '/');
-		if (q)
-			d = q;
-		else
-			d += strlen(d);  // make sure the sentinel-patching doesn't damage the last part of the original path spec
+		fz_copy_ephemeral_errno(ctx);
+		ASSERT(fz_ctx_get_system_errormsg(ctx) != NULL);
 	}
 
 	fz_free(ctx, pname);
-	return 0;
+	return rv;
 #endif
 }
 
@@ -1684,7 +2122,7 @@ fz_mkdir(fz_context* ctx, const char* path)
 
 	return ret;
 #else
-	return mkdir(path, S_IRWXU | S_IRWXG | S_IRWXO);
+	return mkdir(path, FZ_MKDIR_MODE);
 #endif
 }
 
@@ -2250,62 +2688,36 @@ bool tool_create_output_file(struct OutStruct* outs,
 			fn_ext_pos = fn_ext - fname;
 		}
 
-		fn_ext = strdup(fname + fn_ext_pos);
-		if (!fn_ext) {
-			errorf(global, "out of memory");
+		size_t len = strlen(fname);
+		const char* infix = (hidden ? "__hidden__" : "");
+		size_t newlen = len + strlen(infix) + 11; /* nul + dot + 1-9 digits */
+		char* newname;
+
+		/* Guard against wraparound in new filename */
+		if (newlen < len) {
+			errorf(global, "overflow in filename generation");
 			free(fname);
 			return FALSE;
 		}
 
-		do {
-			fd = open(fname, O_CREAT | O_WRONLY | O_EXCL | O_BINARY, OPENMODE);
-			/* Keep retrying in the hope that it is not interrupted sometime */
-		} while (fd == -1 && errno == EINTR);
-		if (fd == -1) {
-			int next_num = 1;
-			size_t len = strlen(fname);
-			size_t newlen = len + 13; /* nul + 1-11 digits + dot */
-			char* newname = NULL;
-
-			/* Guard against wraparound in new filename */
-			if (newlen < len) {
-				errorf(global, "overflow in filename generation");
-				free(fn_ext);
-				free(fname);
-				return FALSE;
-			}
-
-			bool has_risky_filename = hidden;
-
-			while (fd == -1 && /* have not successfully opened a file */
-				(errno == EEXIST || errno == EISDIR) &&
-				/* because we keep having files that already exist */
-				next_num < 100 /* and we have not reached the retry limit */) {
-				free(newname);
-				newname = aprintf("%.*s%s.%02d%s", fn_ext_pos, fname, (has_risky_filename ? "__hidden__" : ""), next_num, fn_ext);
-				if (!newname) {
-					errorf(global, "out of memory");
-					free(fn_ext);
-					free(fname);
-					return FALSE;
-				}
-				next_num++;
-				do {
-					fd = open(newname, O_CREAT | O_WRONLY | O_EXCL | O_BINARY, OPENMODE);
-					/* Keep retrying in the hope that it is not interrupted sometime */
-				} while (fd == -1 && errno == EINTR);
-			}
-
+		newname = malloc(newlen);
+		if (!newname) {
+			errorf(global, "out of memory");
 			free(fname);
-			fname = newname;
+			return FALSE;
 		}
 
-		Curl_safefree(fn_ext);
+		/* open fname itself or, when that one exists, the first free numbered name: the
+		   next free number is remembered, so the Nth duplicate does not cost N open()s */
+		fd = pathutils_open_unique_file(fname, fn_ext_pos, infix, O_WRONLY | O_BINARY, OPENMODE, newname, newlen);
+
+		free(fname);
+		fname = newname;
 
 		/* An else statement to not overwrite existing files and not retry with
 			 new numbered names (which would cover
 			 config->file_clobber_mode == CLOBBER_DEFAULT && outs->is_cd_filename)
-			 is not needed because we would have failed earlier, in the while loop
+			 is not needed because we would have failed earlier, in pathutils_open_unique_file()
 			 and `fd` would now be -1 */
 		if (fd != -1) {
 			file = fdopen(fd, "wb");
@@ -2659,6 +3071,7 @@ size_t tool_write_cb(char* buffer, size_t sz, size_t nmemb, void* userdata)
 
 #include "tool_bname.h"
 #include "tool_doswin.h"
+#include "pathutils.h"
 
 #include "curlx.h"
 #include "memdebug.h" /* keep this as LAST include */
@@ -2696,15 +3109,15 @@ static CurlSanitizeCode rename_if_reserved_dos_device_name(char** const sanitize
 	int flags);
 #endif /* !UNITTESTS (static declarations used if no unit tests) */
 
-static size_t get_max_sanitized_len(const char* file_name, int flags);
-
-// move src to dst, where the copy in dst will overlap the source in src
-static void strmov(char* dst, char* src) {
-	if (dst < src) {
-		// use memmove() as that one explicitly supports overlapping memory areas:
-		memmove(dst, src, strlen(src) + 1);
-	}
-}
+static size_t get_max_sanitized_len(const char* file_name, size_t len, int flags);
+static CurlSanitizeCode truncate_dryrun_len(const char* path, size_t len,
+	const size_t truncate_pos);
+static CurlSanitizeCode sanitize_file_name_into(char* const target, size_t target_size,
+	const char* file_name, size_t name_len,
+	int flags);
+static CurlSanitizeCode rename_reserved_dos_device_name_in_place(char* target,
+	size_t target_size,
+	int flags);
 
 /*
 Sanitize a file or path name.
@@ -2745,10 +3158,9 @@ Failure: (!= CURL_SANITIZE_ERR_OK) *sanitized is NULL.
 */
 CurlSanitizeCode curl_sanitize_file_name(char** const sanitized, const char* file_name, int flags)
 {
-	char* p, * target;
-	size_t len;
+	char* target;
+	size_t len, target_size;
 	CurlSanitizeCode sc;
-	size_t max_sanitized_len;
 
 	if (!sanitized)
 		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
@@ -2759,212 +3171,287 @@ CurlSanitizeCode curl_sanitize_file_name(char** const sanitized, const char* fil
 		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
 
 	len = strlen(file_name);
-	max_sanitized_len = get_max_sanitized_len(file_name, flags);
+
+	/* Room for the sanitized name plus the '_' prefixes which may be added to
+	   reserved device names. Longer names are truncated or rejected anyway. */
+	target_size = (len < 32767 - 1 ? len : 32767 - 1) + 3;
+#ifdef MSDOS
+	/* msdosify() may lengthen the name */
+	if (target_size < PATH_MAX + 3)
+		target_size = PATH_MAX + 3;
+#endif
+
+	target = malloc(target_size);
+	if (!target)
+		return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
+
+	sc = sanitize_file_name_into(target, target_size, file_name, len, flags);
+	if (sc) {
+		free(target);
+		return sc;
+	}
+
+	*sanitized = target;
+	return CURL_SANITIZE_ERR_OK;
+}
+
+/*
+Sanitize a file or path name into a caller-supplied buffer.
+
+Identical to curl_sanitize_file_name(), but writes the sanitized name into
+'sanitized' instead of allocating it. The name in 'file_name' ends at the
+first NUL or after 'file_name_len' characters, whichever comes first, so it
+does not have to be NUL-terminated.
+
+A buffer of the (possibly truncated) name length plus 3 bytes is always large
+enough, except on MS-DOS, where msdosify() may lengthen the name.
+
+Success: (CURL_SANITIZE_ERR_OK) 'sanitized' holds the sanitized copy of file_name.
+Failure: (!= CURL_SANITIZE_ERR_OK) 'sanitized' holds an empty string.
+         CURL_SANITIZE_ERR_BUFFER_TOO_SMALL when the result does not fit.
+*/
+CurlSanitizeCode curl_sanitize_file_name_buf(char* sanitized, size_t sanitized_size, const char* file_name, size_t file_name_len, int flags)
+{
+	const char* nul;
+	CurlSanitizeCode sc;
+
+	if (!sanitized || !sanitized_size)
+		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
+
+	*sanitized = '\0';
+
+	if (!file_name)
+		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
+
+	nul = memchr(file_name, '\0', file_name_len);
+	if (nul)
+		file_name_len = nul - file_name;
+
+	sc = sanitize_file_name_into(sanitized, sanitized_size, file_name, file_name_len, flags);
+	if (sc)
+		*sanitized = '\0';
+	return sc;
+}
+
+/* Return the character 'k' positions ahead of 'p' in the length-bounded
+   source name: at and beyond 'end' we see the NUL sentinel. */
+static char peek_char(const char* p, const char* end, size_t k)
+{
+	return (k < (size_t)(end - p)) ? p[k] : '\0';
+}
+
+/*
+The core of curl_sanitize_file_name: sanitize the first 'name_len' characters
+of 'file_name' into 'target', which can hold 'target_size' bytes.
+
+This is a single pass over the source name: separators are collapsed and path
+segments are trimmed while the name is copied into 'target', so hostile names
+full of '////' cost no more than any other name. Reserved device names are
+renamed in place afterwards, which costs at most a few memmove()s.
+*/
+static CurlSanitizeCode sanitize_file_name_into(char* const target, size_t target_size, const char* file_name, size_t name_len, int flags)
+{
+	const char* r, *end;
+	char* d;
+	size_t len;
+	size_t max_sanitized_len;
+	CurlSanitizeCode sc;
+
+	len = name_len;
+	max_sanitized_len = get_max_sanitized_len(file_name, name_len, flags);
 
 	if (len > max_sanitized_len) {
 		if (!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-			truncate_dryrun(file_name, max_sanitized_len))
+			truncate_dryrun_len(file_name, name_len, max_sanitized_len))
 			return CURL_SANITIZE_ERR_INVALID_PATH;
 
 		len = max_sanitized_len;
 	}
 
-	target = malloc(len + 1);
-	if (!target)
-		return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
+	/* the sanitized name is never longer than the (truncated) source name */
+	if (target_size < len + 1)
+		return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
 
-	strncpy(target, file_name, len);
-	target[len] = '\0';
+	r = file_name;
+	end = file_name + len;
+	d = target;
 
 	if (flags & CURL_SANITIZE_ALLOW_ONLY_RELATIVE_PATH) {
 		flags |= CURL_SANITIZE_ALLOW_PATH;
 		flags &= ~CURL_SANITIZE_ALLOW_COLONS;
 
 		// do not tolerate absolute and UNC paths:
-		if (!strncmp(target, "\\\\?\\", 4))
+		if (len >= 4 && !memcmp(r, "\\\\?\\", 4))
 			/* Skip the literal path prefix \\?\ */
-			p = target + 4;
-		else
-			p = target;
-
-		while (*p == '/' || *p == '\\') {
-			p++;
-		}
+			r += 4;
 
 		// strip off the leading 'root path' bit:
-		strmov(target, p);
+		while (r < end && (*r == '/' || *r == '\\')) {
+			r++;
+		}
 	}
-
 #ifndef MSDOS
-	if ((flags & CURL_SANITIZE_ALLOW_PATH) && !(flags & CURL_SANITIZE_ALLOW_ONLY_RELATIVE_PATH) && !strncmp(target, "\\\\?\\", 4))
-		/* Skip the literal path prefix \\?\ */
-		p = target + 4;
-	else
+	else if ((flags & CURL_SANITIZE_ALLOW_PATH) && len >= 4 && !memcmp(r, "\\\\?\\", 4)) {
+		/* Keep the literal path prefix \\?\ as-is */
+		memcpy(d, r, 4);
+		d += 4;
+		r += 4;
+	}
 #endif
-		p = target;
 
 	/* replace control characters and other banned characters */
 	bool s_o_p = TRUE;
 	bool dot = FALSE;
-	for (; *p; ++p) {
-		if (*p == '.') {
+	while (r < end) {
+		char c = *r;
+
+		if (c == '.') {
 			if (s_o_p && !(flags & CURL_SANITIZE_ALLOW_DOTFILES)) {
 				// dotfiles are not allowed!
 				//
 				// Incidentally: make sure this is not some crappy attempt to slip a '..' path in: encode it entirely.
-				*p = '_';
+				*d++ = '_';
 				dot = TRUE;
-				s_o_p = (p[1] == '.');
+				s_o_p = (peek_char(r, end, 1) == '.');
+				r++;
 				continue;
 			}
 
 			// only accept a dot at the start or middle of a *larger* file/dir name, never at the end of the file/dirname.
-			if (!dot && p[1] && p[1] != '/' && p[1] != '\\') {
+			char next = peek_char(r, end, 1);
+			if (!dot && next && next != '/' && next != '\\') {
+				*d++ = c;
 				dot = TRUE;
 				s_o_p = FALSE;
+				r++;
 				continue;
 			}
 
 			if (dot) {
 				// previous character was a '.' as well: sanitize them all!
-				p[-1] = '_';
+				d[-1] = '_';
 			}
-			*p = '_';
+			*d++ = '_';
 			s_o_p = FALSE;
+			r++;
 			continue;
 		}
 
 		dot = FALSE;
 
-		if (*p == '/' || *p == '\\') {
+		if (c == '/' || c == '\\') {
 			if (flags & CURL_SANITIZE_ALLOW_PATH) {
-				*p = '/';	// convert to UNIX-style path separator
-
 				// and when we've hit our first path separator like that, we do no longer tolerate colons in the path either!
 				flags &= ~CURL_SANITIZE_ALLOW_COLONS;
 
 				s_o_p = TRUE;
 
-				// replace multiple-'/' sequences with a single '/' iff this is to be a path 
-				int i = 1;
-				for (; p[i] == '/' || p[i] == '\\'; i++)
-					;
-				if (i > 1)
-					strmov(p + 1, p + i);
-
 				// remove trailing spaces and periods per path segment
-				char* q;
-				for (q = p - 1; q >= target; q--) {
-					if (*q != ' ' && *q != '.')
-						break;
-				}
-				q++;
+				while (d > target && (d[-1] == ' ' || d[-1] == '.'))
+					d--;
 
-				if (q != p) {
-					strmov(q, p);
-					p = q;
-				}
+				*d++ = '/';	// convert to UNIX-style path separator
+
+				// replace multiple-'/' sequences with a single '/' iff this is to be a path
+				r++;
+				while (r < end && (*r == '/' || *r == '\\'))
+					r++;
 				continue;
 			}
 
-			*p = '_';
+			*d++ = '_';
 			s_o_p = FALSE;
+			r++;
 			continue;
 		}
 
-		if ((1 <= *p && *p <= 31) || (*p == 0x7F)) {
-			*p = '_';
+		// replace control characters and the characters which are illegal or risky on any of the supported platforms:
+		if (pathutils_byte_is(c, PATHUTILS_BYTEPROFILE_CURL)) {
+			*d++ = '_';
 			s_o_p = FALSE;
+			r++;
 			continue;
 		}
 
 		// replace ':', but strip it off when it's the last thing in the path part, e.g. 'http://' --> 'https/'
-		if (!(flags & (CURL_SANITIZE_ALLOW_COLONS)) && *p == ':') {
-			if (s_o_p || p[1] != '/')
-				*p = '_';
+		if (!(flags & (CURL_SANITIZE_ALLOW_COLONS)) && c == ':') {
+			if (s_o_p || peek_char(r, end, 1) != '/') {
+				*d++ = '_';
+				r++;
+			}
 			else {
-				int i = 2;
-				for (; p[i] == '/' || p[i] == '\\'; i++)
+				// drop the ':' and all but the last of the separators following it: that one is processed next.
+				size_t i = 2;
+				for (; peek_char(r, end, i) == '/' || peek_char(r, end, i) == '\\'; i++)
 					;
-				strmov(p, p + i - 1);
-				p--;
+				r += i - 1;
 			}
 			s_o_p = FALSE;
 			continue;
 		}
 
-		if (strchr("|<>\"&'~`?*$^;#%", *p)) {
-			*p = '_';
-			s_o_p = FALSE;
-			continue;
-		}
-
 		// remove leading spaces and dashes per path segment:
 		//
 		// we remove dashes (`-`) to prevent creating file/dir-names which would otherwise mimmick commandline options, e.g. `-2` --> `_2`
 		if (s_o_p) {
-			if (*p == ' ' || *p == '-' || (*p == '.' && !(flags & CURL_SANITIZE_ALLOW_DOTFILES))) {
-				*p = '_';
+			if (c == ' ' || c == '-') {
+				*d++ = '_';
 
 				// replace a series of any of these at Start-Of-Part (SOP), if any:
-				p++;
-				while (*p == ' ' || *p == '-' || (*p == '.' && !(flags & CURL_SANITIZE_ALLOW_DOTFILES)))
-					*p++ = '_';
-				p--;
+				r++;
+				while (r < end && (*r == ' ' || *r == '-' || (*r == '.' && !(flags & CURL_SANITIZE_ALLOW_DOTFILES))))
+					*d++ = '_', r++;
 				s_o_p = FALSE;
 				continue;
 			}
 		}
 		s_o_p = FALSE;
+		*d++ = c;
+		r++;
 	}
+	*d = '\0';
 
 	// remove trailing spaces and periods if not allowing paths
-	if (!(flags & CURL_SANITIZE_ALLOW_PATH) && len) {
-		char* clip = NULL;
-
-		p = &target[len];
-		do {
-			--p;
-			if (*p != ' ' && *p != '.')
-				break;
-			clip = p;
-		} while (p != target);
-
-		if (clip) {
-			*clip = '\0';
-			len = clip - target;
-		}
+	//
+	// Note: a name which had a 'xyz:/' colon stripped is not trimmed: curl has always
+	// behaved this way, as it looked for the trailing spaces at the unstripped length.
+	if (!(flags & CURL_SANITIZE_ALLOW_PATH) && len && (size_t)(d - target) == len) {
+		while (d > target && (d[-1] == ' ' || d[-1] == '.'))
+			d--;
+		*d = '\0';
 	}
 
 #ifdef MSDOS
-	sc = msdosify(&p, target, flags);
-	free(target);
-	if (sc)
-		return sc;
-	target = p;
-	len = strlen(target);
+	{
+		char* dos_name;
 
-	if (len > max_sanitized_len) {
-		free(target);
-		return CURL_SANITIZE_ERR_INVALID_PATH;
+		sc = msdosify(&dos_name, target, flags);
+		if (sc)
+			return sc;
+		len = strlen(dos_name);
+
+		if (len > max_sanitized_len) {
+			free(dos_name);
+			return CURL_SANITIZE_ERR_INVALID_PATH;
+		}
+		if (len + 1 > target_size) {
+			free(dos_name);
+			return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
+		}
+		memcpy(target, dos_name, len + 1);
+		free(dos_name);
 	}
 #endif
 
 	if (!(flags & CURL_SANITIZE_ALLOW_RESERVED)) {
-		sc = rename_if_reserved_dos_device_name(&p, target, flags);
-		free(target);
+		sc = rename_reserved_dos_device_name_in_place(target, target_size, flags);
 		if (sc)
 			return sc;
-		target = p;
-		len = strlen(target);
 
-		if (len > max_sanitized_len) {
-			free(target);
+		if (strlen(target) > max_sanitized_len)
 			return CURL_SANITIZE_ERR_INVALID_PATH;
-		}
 	}
 
-	*sanitized = target;
 	return CURL_SANITIZE_ERR_OK;
 }
 
@@ -2974,7 +3461,7 @@ Return the maximum allowed length of the (to-be-)sanitized 'file_name'.
 This is a supporting function for any function that returns a sanitized
 filename.
 */
-static size_t get_max_sanitized_len(const char* file_name, int flags)
+static size_t get_max_sanitized_len(const char* file_name, size_t len, int flags)
 {
 	size_t max_sanitized_len;
 
@@ -2984,7 +3471,7 @@ static size_t get_max_sanitized_len(const char* file_name, int flags)
 
 	if ((flags & CURL_SANITIZE_ALLOW_PATH)) {
 #ifdef UNITTESTS
-		if (file_name[0] == '\\' && file_name[1] == '\\')
+		if (len >= 2 && file_name[0] == '\\' && file_name[1] == '\\')
 			max_sanitized_len = 32767 - 1;
 		else
 			max_sanitized_len = 259;
@@ -2995,7 +3482,7 @@ static size_t get_max_sanitized_len(const char* file_name, int flags)
 			 version of Windows. Starting in Windows 10 1607 (build 14393) any path
 			 may be longer than PATH_MAX if the user has opted-in and the application
 			 supports it. */
-		if ((file_name[0] == '\\' && file_name[1] == '\\') ||
+		if ((len >= 2 && file_name[0] == '\\' && file_name[1] == '\\') ||
 			curlx_verify_windows_version(10, 0, 14393, PLATFORM_WINNT,
 				VERSION_GREATER_THAN_EQUAL))
 			max_sanitized_len = 32767 - 1;
@@ -3043,12 +3530,17 @@ SANITIZE_ERR_INVALID_PATH: Bad -- 'path' cannot be truncated
 */
 CurlSanitizeCode truncate_dryrun(const char* path, const size_t truncate_pos)
 {
-	size_t len;
-
 	if (!path)
 		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
 
-	len = strlen(path);
+	return truncate_dryrun_len(path, strlen(path), truncate_pos);
+}
+
+/* truncate_dryrun() for a 'path' of 'len' characters, which does not have to be NUL-terminated */
+static CurlSanitizeCode truncate_dryrun_len(const char* path, size_t len,
+	const size_t truncate_pos)
+{
+	size_t i;
 
 	if (truncate_pos > len)
 		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
@@ -3056,8 +3548,10 @@ CurlSanitizeCode truncate_dryrun(const char* path, const size_t truncate_pos)
 	if (!len || !truncate_pos)
 		return CURL_SANITIZE_ERR_INVALID_PATH;
 
-	if (strpbrk(&path[truncate_pos - 1], "\\/:"))
-		return CURL_SANITIZE_ERR_INVALID_PATH;
+	for (i = truncate_pos - 1; i < len; i++) {
+		if (path[i] == '\\' || path[i] == '/' || path[i] == ':')
+			return CURL_SANITIZE_ERR_INVALID_PATH;
+	}
 
 	/* C:\foo can be truncated but C:\foo:ads cannot */
 	if (truncate_pos > 1) {
@@ -3247,11 +3741,9 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char** const sanitized,
 	const char* file_name,
 	int flags)
 {
-	char* p, * base, * target;
-	size_t t_len, max_sanitized_len;
-#ifdef MSDOS
-	struct_stat st_buf;
-#endif
+	char* target;
+	size_t t_len, target_size;
+	CurlSanitizeCode sc;
 
 	if (!sanitized)
 		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
@@ -3261,28 +3753,56 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char** const sanitized,
 	if (!file_name)
 		return CURL_SANITIZE_ERR_BAD_ARGUMENT;
 
-	max_sanitized_len = get_max_sanitized_len(file_name, flags);
-
+	/* room for the '_' prefixes */
 	t_len = strlen(file_name);
+	target_size = t_len + 3;
+
+	target = malloc(target_size);
+	if (!target)
+		return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
+
+	memcpy(target, file_name, t_len + 1);
+
+	sc = rename_reserved_dos_device_name_in_place(target, target_size, flags);
+	if (sc) {
+		free(target);
+		return sc;
+	}
+
+	*sanitized = target;
+	return CURL_SANITIZE_ERR_OK;
+}
+
+/*
+The core of rename_if_reserved_dos_device_name: rename the reserved dos device
+names in 'target', in place. 'target' can hold 'target_size' bytes; every
+rename adds one character, unless the name must be truncated to make room.
+*/
+static CurlSanitizeCode rename_reserved_dos_device_name_in_place(char* target,
+	size_t target_size,
+	int flags)
+{
+	char* p, *base;
+	size_t t_len, max_sanitized_len;
+#ifdef MSDOS
+	struct_stat st_buf;
+#endif
+
+	t_len = strlen(target);
+	max_sanitized_len = get_max_sanitized_len(target, t_len, flags);
+
 	if (t_len > max_sanitized_len) {
 		if (!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-			truncate_dryrun(file_name, max_sanitized_len))
+			truncate_dryrun_len(target, t_len, max_sanitized_len))
 			return CURL_SANITIZE_ERR_INVALID_PATH;
 
 		t_len = max_sanitized_len;
+		target[t_len] = '\0';
 	}
 
-	target = malloc(t_len + 1);
-	if (!target)
-		return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
-
-	strncpy(target, file_name, t_len);
-	target[t_len] = '\0';
-
 #ifndef MSDOS
 	if ((flags & CURL_SANITIZE_ALLOW_PATH) &&
-		file_name[0] == '\\' && file_name[1] == '\\') {
-		*sanitized = target;
+		target[0] == '\\' && target[1] == '\\') {
 		return CURL_SANITIZE_ERR_OK;
 	}
 #endif
@@ -3299,15 +3819,9 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char** const sanitized,
 		 */
 	for (p = target; p; p = (p == target && target != base ? base : NULL)) {
 		size_t p_len;
-		int x = (curl_strnequal(p, "CON", 3) ||
-			curl_strnequal(p, "PRN", 3) ||
-			curl_strnequal(p, "AUX", 3) ||
-			curl_strnequal(p, "NUL", 3)) ? 3 :
-			(curl_strnequal(p, "CLOCK$", 6)) ? 6 :
-			(curl_strnequal(p, "COM", 3) || curl_strnequal(p, "LPT", 3)) ?
-			(('1' <= p[3] && p[3] <= '9') ? 4 : 3) : 0;
-
-		if (!x)
+		size_t x;
+
+		if (!pathutils_match_dos_device(p, strlen(p), &x))
 			continue;
 
 		/* the devices may be accessible with an extension or ADS, for
@@ -3339,21 +3853,12 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char** const sanitized,
 			--p_len;
 			--t_len;
 			if (!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-				truncate_dryrun(target, t_len)) {
-				free(target);
+				truncate_dryrun(target, t_len))
 				return CURL_SANITIZE_ERR_INVALID_PATH;
-			}
 			target[t_len] = '\0';
 		}
-		else {
-			p = realloc(target, t_len + 2);
-			if (!p) {
-				free(target);
-				return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
-			}
-			target = p;
-			p = target + (t_len - p_len);
-		}
+		else if (t_len + 2 > target_size)
+			return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
 
 		/* prepend '_' to target or base (basename within target) */
 		memmove(p + 1, p, p_len + 1);
@@ -3382,21 +3887,12 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char** const sanitized,
 				--blen;
 				--t_len;
 				if (!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-					truncate_dryrun(target, t_len)) {
-					free(target);
+					truncate_dryrun(target, t_len))
 					return CURL_SANITIZE_ERR_INVALID_PATH;
-				}
 				target[t_len] = '\0';
 			}
-			else {
-				p = realloc(target, t_len + 2);
-				if (!p) {
-					free(target);
-					return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
-				}
-				target = p;
-				base = target + (t_len - blen);
-			}
+			else if (t_len + 2 > target_size)
+				return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
 
 			memmove(base + 1, base, blen + 1);
 			base[0] = '_';
@@ -3406,7 +3902,6 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char** const sanitized,
 	}
 #endif
 
-	* sanitized = target;
 	return CURL_SANITIZE_ERR_OK;
 }
 
@@ -3789,6 +4284,7 @@ static const char* mk_dst_filename(const char* name)
 #pragma once
 
 #include "crow/settings.h"
+#include "pathutils.h"
 
 #include <cstdint>
 #include <stdexcept>
@@ -4508,28 +5004,12 @@ namespace crow
 			if (data.length() > 255)
 				data.resize(255);
 
-			static const auto toUpper = [](char c) {
-				return ((c >= 'a') && (c <= 'z')) ? (c - ('a' - 'A')) : c;
-				};
 			// Check for special device names. The Windows behavior is really odd here, it will consider both AUX and AUX.txt
 			// a special device. Thus we search for the string (case-insensitive), and then check if the string ends or if
 			// is has a dangerous follow up character (.:\/)
-			auto sanitizeSpecialFile = [](std::string& source, unsigned ofs, const char* pattern, bool includeNumber, char replacement) {
-				unsigned i = ofs;
+			auto sanitizeSpecialFile = [](std::string& source, unsigned ofs, size_t special_len, char replacement) {
+				unsigned i = ofs + special_len;
 				size_t len = source.length();
-				const char* p = pattern;
-				while (*p)
-				{
-					if (i >= len) return;
-					if (toUpper(source[i]) != *p) return;
-					++i;
-					++p;
-				}
-				if (includeNumber)
-				{
-					if ((i >= len) || (source[i] < '1') || (source[i] > '9')) return;
-					++i;
-				}
 				if ((i >= len) || (source[i] == '.') || (source[i] == ':') || (source[i] == '/') || (source[i] == '\\'))
 				{
 					source.erase(ofs + 1, (i - ofs) - 1);
@@ -4539,37 +5019,24 @@ namespace crow
 			bool checkForSpecialEntries = true;
 			for (unsigned i = 0; i < data.length(); ++i)
 			{
-				// Recognize directory traversals and the special devices CON/PRN/AUX/NULL/COM[1-]/LPT[1-9]
+				// Recognize directory traversals and the special devices CON/PRN/AUX/NUL/CLOCK$/COM[0-9]/LPT[0-9]
 				if (checkForSpecialEntries)
 				{
 					checkForSpecialEntries = false;
-					switch (toUpper(data[i]))
+					size_t special_len;
+					if (pathutils_match_dos_device(data.data() + i, data.length() - i, &special_len) != PATHUTILS_DOS_DEVICE_NONE)
 					{
-					case 'A':
-						sanitizeSpecialFile(data, i, "AUX", false, replacement);
-						break;
-					case 'C':
-						sanitizeSpecialFile(data, i, "CON", false, replacement);
-						sanitizeSpecialFile(data, i, "COM", true, replacement);
-						break;
-					case 'L':
-						sanitizeSpecialFile(data, i, "LPT", true, replacement);
-						break;
-					case 'N':
-						sanitizeSpecialFile(data, i, "NUL", false, replacement);
-						break;
-					case 'P':
-						sanitizeSpecialFile(data, i, "PRN", false, replacement);
-						break;
-					case '.':
-						sanitizeSpecialFile(data, i, "..", false, replacement);
-						break;
+						sanitizeSpecialFile(data, i, special_len, replacement);
+					}
+					else if (data.compare(i, 2, "..") == 0)
+					{
+						sanitizeSpecialFile(data, i, 2, replacement);
 					}
 				}
 
 				// Sanitize individual characters
 				unsigned char c = data[i];
-				if ((c < ' ') || ((c >= 0x80) && (c <= 0x9F)) || (c == '?') || (c == '<') || (c == '>') || (c == ':') || (c == '*') || (c == '|') || (c == '\"'))
+				if (pathutils_byte_is(c, PATHUTILS_BYTEPROFILE_CROW))
 				{
 					data[i] = replacement;
 				}
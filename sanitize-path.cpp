@@ -0,0 +1,47 @@
+
+#include "pathutils.hpp"
+#include "pathutils.h"
+
+#include <string.h>
+
+namespace pathutils {
+
+	std::optional<std::string_view> sanitize_path(std::string_view path, std::span<char> dst, const pathutils_sanitize_policy *policy)
+	{
+		if (dst.size() < path.size() + 1)
+			return std::nullopt;
+
+		// the sanitizer works in place and its output is never longer than its input: copy the input once, straight into the output buffer.
+		memmove(dst.data(), path.data(), path.size());
+		dst[path.size()] = 0;
+		fz_sanitize_path_with_policy(dst.data(), policy, 0, dst.size());
+		return std::string_view(dst.data(), strlen(dst.data()));
+	}
+
+	void sanitize_path(std::string_view path, std::string &dst, const pathutils_sanitize_policy *policy)
+	{
+		// assign() reuses the existing capacity of `dst`, so this only allocates when `dst` is too small.
+		dst.assign(path);
+		fz_sanitize_path_with_policy(dst.data(), policy, 0, dst.size() + 1);
+		dst.resize(strlen(dst.c_str()));
+	}
+
+#if defined(_WIN32) || defined(MSDOS)
+	CurlSanitizeCode curl_sanitize_file_name(std::string_view file_name, std::span<char> dst, std::string_view &sanitized, int flags)
+	{
+		CurlSanitizeCode rv = curl_sanitize_file_name_buf(dst.data(), dst.size(), file_name.data(), file_name.size(), flags);
+		sanitized = (rv == CURL_SANITIZE_ERR_OK ? std::string_view(dst.data(), strlen(dst.data())) : std::string_view());
+		return rv;
+	}
+
+	CurlSanitizeCode curl_sanitize_file_name(std::string_view file_name, std::string &dst, int flags)
+	{
+		// room for the '_' prefixes which may be added to reserved device names; resize() reuses the existing capacity of `dst`.
+		dst.resize(file_name.size() + 2);
+		CurlSanitizeCode rv = curl_sanitize_file_name_buf(dst.data(), dst.size() + 1, file_name.data(), file_name.size(), flags);
+		dst.resize(strlen(dst.c_str()));
+		return rv;
+	}
+#endif
+
+}
@@ -9,58 +9,18 @@
 
 namespace pathutils {
 
-	// CON, PRN, AUX, NUL 
-	// COM1, COM2, COM3, COM4, COM5, COM6, COM7, COM8, COM9
-	// LPT1, LPT2, LPT3, LPT4, LPT5, LPT6, LPT7, LPT8, LPT9
-
-	static inline bool streq(const char *s1, const char *s2)
-	{
-		return strcmp(s1, s2) == 0;
-	}
-
-	static inline bool strneq(const char *s1, const char *s2, size_t len)
-	{
-		return strncmp(s1, s2, len) == 0;
-	}
-
-	static inline bool strieq(const char *s1, const char *s2)
-	{
-		return stricmp(s1, s2) == 0;
-	}
-
-	static inline bool strnieq(const char *s1, const char *s2, size_t len)
-	{
-		return strnicmp(s1, s2, len) == 0;
-	}
-
+	// CON, PRN, AUX, NUL, CLOCK$, COM0..COM9, LPT0..LPT9: see pathutils_match_dos_device(); optionally followed by a ':'.
 	bool name_is_antiquated_dos_device(const char *path, size_t len)
 	{
-		if (len <= 5 && len >= 3) {
-			if (strnieq(path, "nul", 3) || strnieq(path, "con", 3) || strnieq(path, "aux", 3) || strnieq(path, "prn", 3)) {
-				if (len == 3 || strneq(path + 3, ":", len - 3)) {
-					return true;
-				}
-				return true;
-			}
-			if (strnieq(path, "com", 3) || strnieq(path, "lpt", 3)) {
-				unsigned int offset = 3;
-				if (len > 3 && ('1' <= path[3] && path[3] <= '9'))
-					offset++;
-				if (len == offset || strneq(path + offset, ":", len - offset)) {
-					return true;
-				}
-			}
-		}
-		return false;
+		size_t n;
+		if (pathutils_match_dos_device(path, len, &n) == PATHUTILS_DOS_DEVICE_NONE)
+			return false;
+		return len == n || (len == n + 1 && path[n] == ':');
 	}
 
 	bool name_is_antiquated_dos_device(const char *path)
 	{
-		auto len = strlen(path);
-		if (len <= 5) {
-			return name_is_antiquated_dos_device(path, len);
-		}
-		return false;
+		return name_is_antiquated_dos_device(path, strlen(path));
 	}
 
 
@@ -322,7 +282,12 @@ namespace pathutils {
 				}
 
 				// sanitize the appended part: lingering drive colons, wildcards, etc. will be replaced by _:
-				fz_sanitize_path_ex(appendedpath, "^$!", "_", 0, strlen(output_path_mapping_spec[idx].abs_target_path));
+				static const pathutils_sanitize_policy mapping_policy = [] {
+					pathutils_sanitize_policy policy;
+					pathutils_compile_sanitize_policy(&policy, "^$!", "_", PATHUTILS_SANITIZE_HASH_FULL_PATH);
+					return policy;
+				}();
+				fz_sanitize_path_with_policy(appendedpath, &mapping_policy, 0, strlen(output_path_mapping_spec[idx].abs_target_path));
 
 				if (dst_len == 0 || dst_len > strlen(appendedpath))
 				{
@@ -427,7 +392,12 @@ namespace pathutils {
 		}
 
 		// sanitize the appended part: lingering drive colons, wildcards, etc. will be replaced by _:
-		fz_sanitize_path_ex(appendedpath, "^$!", "_", 0, strlen(output_path_mapping_spec[idx].abs_target_path));
+		static const pathutils_sanitize_policy mapping_policy = [] {
+			pathutils_sanitize_policy policy;
+			pathutils_compile_sanitize_policy(&policy, "^$!", "_", PATHUTILS_SANITIZE_HASH_FULL_PATH);
+			return policy;
+		}();
+		fz_sanitize_path_with_policy(appendedpath, &mapping_policy, 0, strlen(output_path_mapping_spec[idx].abs_target_path));
 
 		if (dst_len == 0 || dst_len > strlen(appendedpath))
 		{
@@ -0,0 +1,111 @@
+
+#include "gtest/gtest.h"
+
+#include "mupdf/fitz.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pathutils.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// fz_stat_many() must report exactly what a stat per path reports, whichever backend it picks (io_uring or the
+// worker pool): run it against a scratch tree on tmpfs (/dev/shm), which holds directories, files of all sizes and
+// a few paths which cannot be stat-ed.
+
+#if !defined(_WIN32)
+
+class puFileStat : public ::testing::Test {
+protected:
+	void SetUp() override {
+		std::error_code ec;
+		root_ = std::filesystem::is_directory("/dev/shm", ec) ? std::filesystem::path("/dev/shm") : std::filesystem::temp_directory_path();
+		root_ /= "pathutils-test-file-stat";
+		std::filesystem::remove_all(root_, ec);
+
+		for (int d = 0; d < 10; d++) {
+			std::filesystem::path dir = root_ / ("d" + std::to_string(d));
+			ASSERT_TRUE(std::filesystem::create_directories(dir, ec));
+			paths_.push_back(dir.string());
+			for (int f = 0; f < 99; f++) {
+				std::filesystem::path file = dir / ("f" + std::to_string(f) + ".dat");
+				std::ofstream(file) << std::string((size_t)(d * f) % 300, 'x');
+				paths_.push_back(file.string());
+			}
+		}
+		paths_.push_back((root_ / "missing").string());
+		paths_.push_back((root_ / "d0" / "f0.dat" / "not-a-dir").string());
+
+		ctx_ = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+		ASSERT_NE(ctx_, nullptr);
+	}
+
+	void TearDown() override {
+		std::error_code ec;
+		std::filesystem::remove_all(root_, ec);
+		fz_drop_context(ctx_);
+	}
+
+	void ExpectSameAsOneByOne(unsigned int mask) {
+		std::vector<const char *> cpaths;
+		for (const auto &p : paths_)
+			cpaths.push_back(p.c_str());
+
+		std::vector<fz_file_info> infos(cpaths.size());
+		size_t failed = fz_stat_many(ctx_, cpaths.data(), cpaths.size(), infos.data(), mask);
+
+		size_t expected_failed = 0;
+		for (size_t i = 0; i < cpaths.size(); i++) {
+			fz_file_info expected;
+			if (pathutils_stat_info(cpaths[i], &expected, mask))
+				expected_failed++;
+			EXPECT_EQ(infos[i].valid, expected.valid) << cpaths[i];
+			EXPECT_EQ(infos[i].is_regular_file, expected.is_regular_file) << cpaths[i];
+			EXPECT_EQ(infos[i].is_directory, expected.is_directory) << cpaths[i];
+			EXPECT_EQ(infos[i].size, expected.size) << cpaths[i];
+			EXPECT_EQ(infos[i].mtime, expected.mtime) << cpaths[i];
+			EXPECT_EQ(infos[i].ctime, expected.ctime) << cpaths[i];
+			EXPECT_EQ(infos[i].error, expected.error) << cpaths[i];
+		}
+		EXPECT_EQ(failed, expected_failed);
+		EXPECT_EQ(failed, 2U);
+	}
+
+	std::filesystem::path root_;
+	std::vector<std::string> paths_;
+	fz_context *ctx_ = nullptr;
+};
+
+TEST_F(puFileStat, StatManyMatchesStatInfo) {
+	ExpectSameAsOneByOne(FZ_STAT_ALL);
+}
+
+TEST_F(puFileStat, StatManyMatchesStatInfoForSizeOnly) {
+	ExpectSameAsOneByOne(FZ_STAT_SIZE);
+}
+
+TEST_F(puFileStat, StatManyKeepsResultsInOrder) {
+	std::vector<const char *> cpaths;
+	for (const auto &p : paths_)
+		cpaths.push_back(p.c_str());
+
+	std::vector<fz_file_info> infos(cpaths.size());
+	fz_stat_many(ctx_, cpaths.data(), cpaths.size(), infos.data(), FZ_STAT_SIZE);
+
+	// every 100th path is a directory; file `f<f>.dat` in `d<d>` has (d * f) % 300 bytes.
+	for (int d = 0; d < 10; d++) {
+		EXPECT_TRUE(infos[d * 100].is_directory);
+		for (int f = 0; f < 99; f++) {
+			const fz_file_info &info = infos[d * 100 + 1 + f];
+			EXPECT_TRUE(info.is_regular_file);
+			EXPECT_EQ(info.size, (d * f) % 300);
+		}
+	}
+}
+
+#endif
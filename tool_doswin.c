@@ -38,6 +38,7 @@
 
 #include "tool_bname.h"
 #include "tool_doswin.h"
+#include "pathutils.h"
 
 #include "curlx.h"
 #include "memdebug.h" /* keep this as LAST include */
@@ -75,15 +76,15 @@ static CurlSanitizeCode rename_if_reserved_dos_device_name(char **const sanitize
                                                        int flags);
 #endif /* !UNITTESTS (static declarations used if no unit tests) */
 
-static size_t get_max_sanitized_len(const char *file_name, int flags);
-
-// move src to dst, where the copy in dst will overlap the source in src
-static void strmov(char *dst, char *src) {
-	if (dst < src) {
-		// use memmove() as that one explicitly supports overlapping memory areas:
-		memmove(dst, src, strlen(src) + 1);
-	}
-}
+static size_t get_max_sanitized_len(const char *file_name, size_t len, int flags);
+static CurlSanitizeCode truncate_dryrun_len(const char *path, size_t len,
+                                        const size_t truncate_pos);
+static CurlSanitizeCode sanitize_file_name_into(char *const target, size_t target_size,
+                                            const char *file_name, size_t name_len,
+                                            int flags);
+static CurlSanitizeCode rename_reserved_dos_device_name_in_place(char *target,
+                                                             size_t target_size,
+                                                             int flags);
 
 /*
 Sanitize a file or path name.
@@ -124,10 +125,9 @@ Failure: (!= CURL_SANITIZE_ERR_OK) *sanitized is NULL.
 */
 CurlSanitizeCode curl_sanitize_file_name(char **const sanitized, const char *file_name, int flags)
 {
-  char *p, *target;
-  size_t len;
+  char *target;
+  size_t len, target_size;
   CurlSanitizeCode sc;
-  size_t max_sanitized_len;
 
   if(!sanitized)
     return CURL_SANITIZE_ERR_BAD_ARGUMENT;
@@ -138,212 +138,287 @@ CurlSanitizeCode curl_sanitize_file_name(char **const sanitized, const char *fil
     return CURL_SANITIZE_ERR_BAD_ARGUMENT;
 
   len = strlen(file_name);
-  max_sanitized_len = get_max_sanitized_len(file_name, flags);
+
+  /* Room for the sanitized name plus the '_' prefixes which may be added to
+     reserved device names. Longer names are truncated or rejected anyway. */
+  target_size = (len < 32767-1 ? len : 32767-1) + 3;
+#ifdef MSDOS
+  /* msdosify() may lengthen the name */
+  if(target_size < PATH_MAX + 3)
+    target_size = PATH_MAX + 3;
+#endif
+
+  target = malloc(target_size);
+  if(!target)
+    return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
+
+  sc = sanitize_file_name_into(target, target_size, file_name, len, flags);
+  if(sc) {
+    free(target);
+    return sc;
+  }
+
+  *sanitized = target;
+  return CURL_SANITIZE_ERR_OK;
+}
+
+/*
+Sanitize a file or path name into a caller-supplied buffer.
+
+Identical to curl_sanitize_file_name(), but writes the sanitized name into
+'sanitized' instead of allocating it. The name in 'file_name' ends at the
+first NUL or after 'file_name_len' characters, whichever comes first, so it
+does not have to be NUL-terminated.
+
+A buffer of the (possibly truncated) name length plus 3 bytes is always large
+enough, except on MS-DOS, where msdosify() may lengthen the name.
+
+Success: (CURL_SANITIZE_ERR_OK) 'sanitized' holds the sanitized copy of file_name.
+Failure: (!= CURL_SANITIZE_ERR_OK) 'sanitized' holds an empty string.
+         CURL_SANITIZE_ERR_BUFFER_TOO_SMALL when the result does not fit.
+*/
+CurlSanitizeCode curl_sanitize_file_name_buf(char *sanitized, size_t sanitized_size, const char *file_name, size_t file_name_len, int flags)
+{
+  const char *nul;
+  CurlSanitizeCode sc;
+
+  if(!sanitized || !sanitized_size)
+    return CURL_SANITIZE_ERR_BAD_ARGUMENT;
+
+  *sanitized = '\0';
+
+  if(!file_name)
+    return CURL_SANITIZE_ERR_BAD_ARGUMENT;
+
+  nul = memchr(file_name, '\0', file_name_len);
+  if(nul)
+    file_name_len = nul - file_name;
+
+  sc = sanitize_file_name_into(sanitized, sanitized_size, file_name, file_name_len, flags);
+  if(sc)
+    *sanitized = '\0';
+  return sc;
+}
+
+/* Return the character 'k' positions ahead of 'p' in the length-bounded
+   source name: at and beyond 'end' we see the NUL sentinel. */
+static char peek_char(const char *p, const char *end, size_t k)
+{
+  return (k < (size_t)(end - p)) ? p[k] : '\0';
+}
+
+/*
+The core of curl_sanitize_file_name: sanitize the first 'name_len' characters
+of 'file_name' into 'target', which can hold 'target_size' bytes.
+
+This is a single pass over the source name: separators are collapsed and path
+segments are trimmed while the name is copied into 'target', so hostile names
+full of '////' cost no more than any other name. Reserved device names are
+renamed in place afterwards, which costs at most a few memmove()s.
+*/
+static CurlSanitizeCode sanitize_file_name_into(char *const target, size_t target_size, const char *file_name, size_t name_len, int flags)
+{
+  const char *r, *end;
+  char *d;
+  size_t len;
+  size_t max_sanitized_len;
+  CurlSanitizeCode sc;
+
+  len = name_len;
+  max_sanitized_len = get_max_sanitized_len(file_name, name_len, flags);
 
   if(len > max_sanitized_len) {
     if(!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-       truncate_dryrun(file_name, max_sanitized_len))
+       truncate_dryrun_len(file_name, name_len, max_sanitized_len))
       return CURL_SANITIZE_ERR_INVALID_PATH;
 
     len = max_sanitized_len;
   }
 
-  target = malloc(len + 1);
-  if(!target)
-    return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
+  /* the sanitized name is never longer than the (truncated) source name */
+  if(target_size < len + 1)
+    return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
 
-  strncpy(target, file_name, len);
-  target[len] = '\0';
+  r = file_name;
+  end = file_name + len;
+  d = target;
 
   if (flags & CURL_SANITIZE_ALLOW_ONLY_RELATIVE_PATH) {
 	flags |= CURL_SANITIZE_ALLOW_PATH;
 	flags &= ~CURL_SANITIZE_ALLOW_COLONS;
 
 	// do not tolerate absolute and UNC paths:
-	if(!strncmp(target, "\\\\?\\", 4))
+	if(len >= 4 && !memcmp(r, "\\\\?\\", 4))
 		/* Skip the literal path prefix \\?\ */
-		p = target + 4;
-	else
-		p = target;
-
-	while (*p == '/' || *p == '\\') {
-		p++;
-	}
+		r += 4;
 
 	// strip off the leading 'root path' bit:
-	strmov(target, p);
+	while (r < end && (*r == '/' || *r == '\\')) {
+		r++;
+	}
   }
-
 #ifndef MSDOS
-  if((flags & CURL_SANITIZE_ALLOW_PATH) && !(flags & CURL_SANITIZE_ALLOW_ONLY_RELATIVE_PATH) && !strncmp(target, "\\\\?\\", 4))
-    /* Skip the literal path prefix \\?\ */
-    p = target + 4;
-  else
+  else if((flags & CURL_SANITIZE_ALLOW_PATH) && len >= 4 && !memcmp(r, "\\\\?\\", 4)) {
+    /* Keep the literal path prefix \\?\ as-is */
+    memcpy(d, r, 4);
+    d += 4;
+    r += 4;
+  }
 #endif
-    p = target;
 
   /* replace control characters and other banned characters */
   bool s_o_p = TRUE;
   bool dot = FALSE;
-  for(; *p; ++p) {
-	if (*p == '.') {
+  while(r < end) {
+	char c = *r;
+
+	if (c == '.') {
 		if (s_o_p && !(flags & CURL_SANITIZE_ALLOW_DOTFILES)) {
 			// dotfiles are not allowed!
 			//
 			// Incidentally: make sure this is not some crappy attempt to slip a '..' path in: encode it entirely.
-			*p = '_';
+			*d++ = '_';
 			dot = TRUE;
-			s_o_p = (p[1] == '.');
+			s_o_p = (peek_char(r, end, 1) == '.');
+			r++;
 			continue;
 		}
 
 		// only accept a dot at the start or middle of a *larger* file/dir name, never at the end of the file/dirname.
-		if (!dot && p[1] && p[1] != '/' && p[1] != '\\') {
+		char next = peek_char(r, end, 1);
+		if (!dot && next && next != '/' && next != '\\') {
+			*d++ = c;
 			dot = TRUE;
 			s_o_p = FALSE;
+			r++;
 			continue;
 		}
 
 		if (dot) {
 			// previous character was a '.' as well: sanitize them all!
-			p[-1] = '_';
+			d[-1] = '_';
 		}
-		*p = '_';
+		*d++ = '_';
 		s_o_p = FALSE;
+		r++;
 		continue;
 	}
 
 	dot = FALSE;
 
-	if (*p == '/' || *p == '\\') {
+	if (c == '/' || c == '\\') {
 		if (flags & CURL_SANITIZE_ALLOW_PATH) {
-			*p = '/';	// convert to UNIX-style path separator
-
 			// and when we've hit our first path separator like that, we do no longer tolerate colons in the path either!
 			flags &= ~CURL_SANITIZE_ALLOW_COLONS;
 
 			s_o_p = TRUE;
 
-			// replace multiple-'/' sequences with a single '/' iff this is to be a path 
-			int i = 1;
-			for ( ; p[i] == '/' || p[i] == '\\'; i++)
-				;
-			if (i > 1)
-				strmov(p + 1, p + i);
-
 			// remove trailing spaces and periods per path segment
-			char *q;
-			for (q = p - 1; q >= target; q--) {
-				if (*q != ' ' && *q != '.')
-					break;
-			} 
-			q++;
-
-			if (q != p) {
-				strmov(q, p);
-				p = q;
-			}
+			while (d > target && (d[-1] == ' ' || d[-1] == '.'))
+				d--;
+
+			*d++ = '/';	// convert to UNIX-style path separator
+
+			// replace multiple-'/' sequences with a single '/' iff this is to be a path
+			r++;
+			while (r < end && (*r == '/' || *r == '\\'))
+				r++;
 			continue;
 		}
 
-		*p = '_';
+		*d++ = '_';
 		s_o_p = FALSE;
+		r++;
 		continue;
 	}
 
-    if ((1 <= *p && *p <= 31) || (*p == 0x7F)) {
-      *p = '_';
+    // replace control characters and the characters which are illegal or risky on any of the supported platforms:
+    if (pathutils_byte_is(c, PATHUTILS_BYTEPROFILE_CURL)) {
+      *d++ = '_';
 	  s_o_p = FALSE;
+	  r++;
 	  continue;
     }
 
 	// replace ':', but strip it off when it's the last thing in the path part, e.g. 'http://' --> 'https/'
-	if (!(flags & (CURL_SANITIZE_ALLOW_COLONS)) && *p == ':') {
-		if (s_o_p || p[1] != '/')
-			*p = '_';
+	if (!(flags & (CURL_SANITIZE_ALLOW_COLONS)) && c == ':') {
+		if (s_o_p || peek_char(r, end, 1) != '/') {
+			*d++ = '_';
+			r++;
+		}
 		else {
-			int i = 2;
-			for (; p[i] == '/' || p[i] == '\\'; i++)
+			// drop the ':' and all but the last of the separators following it: that one is processed next.
+			size_t i = 2;
+			for (; peek_char(r, end, i) == '/' || peek_char(r, end, i) == '\\'; i++)
 				;
-			strmov(p, p + i - 1);
-			p--;
+			r += i - 1;
 		}
 		s_o_p = FALSE;
 		continue;
 	}
 
-	if (strchr("|<>\"&'~`?*$^;#%", *p)) {
-        *p = '_';
-		s_o_p = FALSE;
-		continue;
-	}
-
 	// remove leading spaces and dashes per path segment:
 	//
 	// we remove dashes (`-`) to prevent creating file/dir-names which would otherwise mimmick commandline options, e.g. `-2` --> `_2`
 	if (s_o_p) {
-		if (*p == ' ' || *p == '-' || (*p == '.' && !(flags & CURL_SANITIZE_ALLOW_DOTFILES))) {
-			*p = '_';
+		if (c == ' ' || c == '-') {
+			*d++ = '_';
 
 			// replace a series of any of these at Start-Of-Part (SOP), if any:
-			p++;
-			while (*p == ' ' || *p == '-' || (*p == '.' && !(flags & CURL_SANITIZE_ALLOW_DOTFILES)))
-				*p++ = '_';
-			p--;
+			r++;
+			while (r < end && (*r == ' ' || *r == '-' || (*r == '.' && !(flags & CURL_SANITIZE_ALLOW_DOTFILES))))
+				*d++ = '_', r++;
 			s_o_p = FALSE;
 			continue;
 		}
 	}
 	s_o_p = FALSE;
+	*d++ = c;
+	r++;
   }
+  *d = '\0';
 
   // remove trailing spaces and periods if not allowing paths
-  if(!(flags & CURL_SANITIZE_ALLOW_PATH) && len) {
-    char *clip = NULL;
-
-    p = &target[len];
-    do {
-      --p;
-      if(*p != ' ' && *p != '.')
-        break;
-      clip = p;
-    } while(p != target);
-
-    if(clip) {
-      *clip = '\0';
-      len = clip - target;
-    }
+  //
+  // Note: a name which had a 'xyz:/' colon stripped is not trimmed: curl has always
+  // behaved this way, as it looked for the trailing spaces at the unstripped length.
+  if(!(flags & CURL_SANITIZE_ALLOW_PATH) && len && (size_t)(d - target) == len) {
+    while(d > target && (d[-1] == ' ' || d[-1] == '.'))
+      d--;
+    *d = '\0';
   }
 
 #ifdef MSDOS
-  sc = msdosify(&p, target, flags);
-  free(target);
-  if(sc)
-    return sc;
-  target = p;
-  len = strlen(target);
+  {
+    char *dos_name;
 
-  if(len > max_sanitized_len) {
-    free(target);
-    return CURL_SANITIZE_ERR_INVALID_PATH;
+    sc = msdosify(&dos_name, target, flags);
+    if(sc)
+      return sc;
+    len = strlen(dos_name);
+
+    if(len > max_sanitized_len) {
+      free(dos_name);
+      return CURL_SANITIZE_ERR_INVALID_PATH;
+    }
+    if(len + 1 > target_size) {
+      free(dos_name);
+      return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
+    }
+    memcpy(target, dos_name, len + 1);
+    free(dos_name);
   }
 #endif
 
   if (!(flags & CURL_SANITIZE_ALLOW_RESERVED)) {
-    sc = rename_if_reserved_dos_device_name(&p, target, flags);
-    free(target);
+    sc = rename_reserved_dos_device_name_in_place(target, target_size, flags);
     if(sc)
       return sc;
-    target = p;
-    len = strlen(target);
 
-    if(len > max_sanitized_len) {
-      free(target);
+    if(strlen(target) > max_sanitized_len)
       return CURL_SANITIZE_ERR_INVALID_PATH;
-    }
   }
 
-  *sanitized = target;
   return CURL_SANITIZE_ERR_OK;
 }
 
@@ -353,7 +428,7 @@ Return the maximum allowed length of the (to-be-)sanitized 'file_name'.
 This is a supporting function for any function that returns a sanitized
 filename.
 */
-static size_t get_max_sanitized_len(const char *file_name, int flags)
+static size_t get_max_sanitized_len(const char *file_name, size_t len, int flags)
 {
   size_t max_sanitized_len;
 
@@ -363,7 +438,7 @@ static size_t get_max_sanitized_len(const char *file_name, int flags)
 
   if((flags & CURL_SANITIZE_ALLOW_PATH)) {
 #ifdef UNITTESTS
-    if(file_name[0] == '\\' && file_name[1] == '\\')
+    if(len >= 2 && file_name[0] == '\\' && file_name[1] == '\\')
       max_sanitized_len = 32767-1;
     else
       max_sanitized_len = 259;
@@ -374,7 +449,7 @@ static size_t get_max_sanitized_len(const char *file_name, int flags)
        version of Windows. Starting in Windows 10 1607 (build 14393) any path
        may be longer than PATH_MAX if the user has opted-in and the application
        supports it. */
-    if((file_name[0] == '\\' && file_name[1] == '\\') ||
+    if((len >= 2 && file_name[0] == '\\' && file_name[1] == '\\') ||
        curlx_verify_windows_version(10, 0, 14393, PLATFORM_WINNT,
                                     VERSION_GREATER_THAN_EQUAL))
       max_sanitized_len = 32767-1;
@@ -422,12 +497,17 @@ SANITIZE_ERR_INVALID_PATH: Bad -- 'path' cannot be truncated
 */
 CurlSanitizeCode truncate_dryrun(const char *path, const size_t truncate_pos)
 {
-  size_t len;
-
   if(!path)
     return CURL_SANITIZE_ERR_BAD_ARGUMENT;
 
-  len = strlen(path);
+  return truncate_dryrun_len(path, strlen(path), truncate_pos);
+}
+
+/* truncate_dryrun() for a 'path' of 'len' characters, which does not have to be NUL-terminated */
+static CurlSanitizeCode truncate_dryrun_len(const char *path, size_t len,
+                                        const size_t truncate_pos)
+{
+  size_t i;
 
   if(truncate_pos > len)
     return CURL_SANITIZE_ERR_BAD_ARGUMENT;
@@ -435,8 +515,10 @@ CurlSanitizeCode truncate_dryrun(const char *path, const size_t truncate_pos)
   if(!len || !truncate_pos)
     return CURL_SANITIZE_ERR_INVALID_PATH;
 
-  if(strpbrk(&path[truncate_pos - 1], "\\/:"))
-    return CURL_SANITIZE_ERR_INVALID_PATH;
+  for(i = truncate_pos - 1; i < len; i++) {
+    if(path[i] == '\\' || path[i] == '/' || path[i] == ':')
+      return CURL_SANITIZE_ERR_INVALID_PATH;
+  }
 
   /* C:\foo can be truncated but C:\foo:ads cannot */
   if(truncate_pos > 1) {
@@ -626,11 +708,9 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char **const sanitized,
                                                 const char *file_name,
                                                 int flags)
 {
-  char *p, *base, *target;
-  size_t t_len, max_sanitized_len;
-#ifdef MSDOS
-  struct_stat st_buf;
-#endif
+  char *target;
+  size_t t_len, target_size;
+  CurlSanitizeCode sc;
 
   if(!sanitized)
     return CURL_SANITIZE_ERR_BAD_ARGUMENT;
@@ -640,28 +720,56 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char **const sanitized,
   if(!file_name)
     return CURL_SANITIZE_ERR_BAD_ARGUMENT;
 
-  max_sanitized_len = get_max_sanitized_len(file_name, flags);
-
+  /* room for the '_' prefixes */
   t_len = strlen(file_name);
+  target_size = t_len + 3;
+
+  target = malloc(target_size);
+  if(!target)
+    return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
+
+  memcpy(target, file_name, t_len + 1);
+
+  sc = rename_reserved_dos_device_name_in_place(target, target_size, flags);
+  if(sc) {
+    free(target);
+    return sc;
+  }
+
+  *sanitized = target;
+  return CURL_SANITIZE_ERR_OK;
+}
+
+/*
+The core of rename_if_reserved_dos_device_name: rename the reserved dos device
+names in 'target', in place. 'target' can hold 'target_size' bytes; every
+rename adds one character, unless the name must be truncated to make room.
+*/
+static CurlSanitizeCode rename_reserved_dos_device_name_in_place(char *target,
+                                                             size_t target_size,
+                                                             int flags)
+{
+  char *p, *base;
+  size_t t_len, max_sanitized_len;
+#ifdef MSDOS
+  struct_stat st_buf;
+#endif
+
+  t_len = strlen(target);
+  max_sanitized_len = get_max_sanitized_len(target, t_len, flags);
+
   if(t_len > max_sanitized_len) {
     if(!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-       truncate_dryrun(file_name, max_sanitized_len))
+       truncate_dryrun_len(target, t_len, max_sanitized_len))
       return CURL_SANITIZE_ERR_INVALID_PATH;
 
     t_len = max_sanitized_len;
+    target[t_len] = '\0';
   }
 
-  target = malloc(t_len + 1);
-  if(!target)
-    return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
-
-  strncpy(target, file_name, t_len);
-  target[t_len] = '\0';
-
 #ifndef MSDOS
   if((flags & CURL_SANITIZE_ALLOW_PATH) &&
-     file_name[0] == '\\' && file_name[1] == '\\') {
-    *sanitized = target;
+     target[0] == '\\' && target[1] == '\\') {
     return CURL_SANITIZE_ERR_OK;
   }
 #endif
@@ -678,15 +786,9 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char **const sanitized,
      */
   for(p = target; p; p = (p == target && target != base ? base : NULL)) {
     size_t p_len;
-    int x = (curl_strnequal(p, "CON", 3) ||
-             curl_strnequal(p, "PRN", 3) ||
-             curl_strnequal(p, "AUX", 3) ||
-             curl_strnequal(p, "NUL", 3)) ? 3 :
-            (curl_strnequal(p, "CLOCK$", 6)) ? 6 :
-            (curl_strnequal(p, "COM", 3) || curl_strnequal(p, "LPT", 3)) ?
-              (('1' <= p[3] && p[3] <= '9') ? 4 : 3) : 0;
-
-    if(!x)
+    size_t x;
+
+    if(!pathutils_match_dos_device(p, strlen(p), &x))
       continue;
 
     /* the devices may be accessible with an extension or ADS, for
@@ -718,21 +820,12 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char **const sanitized,
       --p_len;
       --t_len;
       if(!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-         truncate_dryrun(target, t_len)) {
-        free(target);
+         truncate_dryrun(target, t_len))
         return CURL_SANITIZE_ERR_INVALID_PATH;
-      }
       target[t_len] = '\0';
     }
-    else {
-      p = realloc(target, t_len + 2);
-      if(!p) {
-        free(target);
-        return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
-      }
-      target = p;
-      p = target + (t_len - p_len);
-    }
+    else if(t_len + 2 > target_size)
+      return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
 
     /* prepend '_' to target or base (basename within target) */
     memmove(p + 1, p, p_len + 1);
@@ -761,21 +854,12 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char **const sanitized,
         --blen;
         --t_len;
         if(!(flags & CURL_SANITIZE_ALLOW_TRUNCATE) ||
-           truncate_dryrun(target, t_len)) {
-          free(target);
+           truncate_dryrun(target, t_len))
           return CURL_SANITIZE_ERR_INVALID_PATH;
-        }
         target[t_len] = '\0';
       }
-      else {
-        p = realloc(target, t_len + 2);
-        if(!p) {
-          free(target);
-          return CURL_SANITIZE_ERR_OUT_OF_MEMORY;
-        }
-        target = p;
-        base = target + (t_len - blen);
-      }
+      else if(t_len + 2 > target_size)
+        return CURL_SANITIZE_ERR_BUFFER_TOO_SMALL;
 
       memmove(base + 1, base, blen + 1);
       base[0] = '_';
@@ -785,7 +869,6 @@ CurlSanitizeCode rename_if_reserved_dos_device_name(char **const sanitized,
   }
 #endif
 
-  *sanitized = target;
   return CURL_SANITIZE_ERR_OK;
 }
 
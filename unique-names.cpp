@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#include <stdlib.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "pathutils.h"
+
+// pathutils_open_unique_file(): create the file `path`, or, when that one is taken, a new file `<stem><infix>.<NN><ext>`
+// next to it.
+//
+// Trying `<stem>.01<ext>`, `<stem>.02<ext>`, ... in turn until an exclusive create succeeds costs N syscalls for the
+// Nth duplicate, and thus N^2 / 2 for N downloads which all want the same name, e.g. a crawler saving thousands of
+// `index.html` files into one directory. Instead:
+//
+// - we remember the next free suffix for every (directory, stem, infix, ext) we have handed out a name for, so the next
+//   duplicate usually costs a single create. The suffix is reserved while the lock is held, so threads asking for the
+//   same name get different suffixes from the start. The directory is identified by device and inode (by absolute path
+//   on Windows), so a relative `path` still refers to the same memory after a chdir(), and never to another directory's.
+// - without such a memory (first call, another process created files behind our back, or the memory has been cleared
+//   or turned out to be stale), we gallop: check suffixes `s`, `s+1`, `s+3`, `s+7`, ... for existence until a free
+//   one is found, then binary search for the lowest free suffix in the last gap. Given the usual densely numbered set
+//   of duplicates, that is O(log N) stats plus one create.
+//
+// Existence checks only guide the search: the actual create is always an O_CREAT|O_EXCL open, so a name which was
+// taken in the meantime is never overwritten; we merely gallop on from there.
+//
+// Files may be deleted behind our back, so the memory is only a hint. `path` itself is always tried first, and the
+// remembered suffix is only used while the name with the suffix before it still exists; otherwise the memory is
+// dropped and we gallop from the start. Deleting only some of the numbered files still leaves their suffixes unused
+// until pathutils_unique_names_clear() is called.
+
+#if defined(_WIN32)
+#define open    _open
+#endif
+
+namespace pathutils {
+
+	namespace {
+
+		// the largest suffix we hand out; beyond that, the name is reported as taken (EEXIST).
+		constexpr unsigned int max_suffix = 999999999;
+		// forget everything when remembering more (stem, infix, ext) combinations than this.
+		constexpr size_t max_remembered_names = 4096;
+
+		std::mutex next_suffix_lock;
+		std::unordered_map<std::string, unsigned int> next_suffix;
+
+		inline bool is_path_separator(char c)
+		{
+#if defined(_WIN32)
+			return c == '/' || c == '\\';
+#else
+			return c == '/';
+#endif
+		}
+
+		// Build the key for the memory of `path`; return false when its directory cannot be identified.
+		bool name_key(const char *path, size_t ext_pos, const char *infix, std::string &key)
+		{
+			const char *base = path + strlen(path);
+			while (base > path && !is_path_separator(base[-1]))
+				base--;
+			std::string dir(path, base - path);
+			if (dir.empty())
+				dir = ".";
+#if defined(_WIN32)
+			char *abs = _fullpath(NULL, dir.c_str(), 0);
+			if (!abs)
+				return false;
+			key = abs;
+			free(abs);
+#else
+			struct stat st;
+			if (stat(dir.c_str(), &st) != 0)
+				return false;
+			key = std::to_string((unsigned long long)st.st_dev);
+			key += ':';
+			key += std::to_string((unsigned long long)st.st_ino);
+#endif
+			key += '\0';
+			key += base;
+			key += '\0';
+			key += infix;
+			key += '\0';
+			key += path + ext_pos;
+			return true;
+		}
+
+		// Return the remembered next free suffix and reserve it by moving the memory one up; return 0 when unknown.
+		unsigned int reserve_suffix(const std::string &key)
+		{
+			std::lock_guard<std::mutex> guard(next_suffix_lock);
+			auto it = next_suffix.find(key);
+			if (it == next_suffix.end() || it->second > max_suffix)
+				return 0;
+			return it->second++;
+		}
+
+		void remember_suffix(const std::string &key, unsigned int used)
+		{
+			std::lock_guard<std::mutex> guard(next_suffix_lock);
+			if (next_suffix.size() >= max_remembered_names && next_suffix.find(key) == next_suffix.end())
+				next_suffix.clear();
+			unsigned int &next = next_suffix[key];
+			if (next <= used)
+				next = used + 1;
+		}
+
+		void forget_suffix(const std::string &key)
+		{
+			std::lock_guard<std::mutex> guard(next_suffix_lock);
+			next_suffix.erase(key);
+		}
+
+		// Write the name with suffix `n` (0: the name as-is) to `buf`; return false when it does not fit.
+		bool format_name(char *buf, size_t bufsize, const char *path, size_t ext_pos, const char *infix, unsigned int n)
+		{
+			int len;
+			if (n == 0)
+				len = snprintf(buf, bufsize, "%s", path);
+			else
+				len = snprintf(buf, bufsize, "%.*s%s.%02u%s", (int)ext_pos, path, infix, n, path + ext_pos);
+			if (len < 0 || (size_t)len >= bufsize) {
+				errno = ENAMETOOLONG;
+				return false;
+			}
+			return true;
+		}
+
+		bool name_exists(const char *name)
+		{
+#if defined(_WIN32)
+			struct _stat64 st;
+			return _stat64(name, &st) == 0;
+#else
+			// lstat(): a dangling symlink makes an exclusive create fail as well.
+			struct stat st;
+			return lstat(name, &st) == 0;
+#endif
+		}
+
+		// Return -1 with errno EEXIST or EISDIR when the name is taken, or -1 with another errno on (real) failure.
+		int create_exclusive(const char *name, int flags, int mode)
+		{
+			int fd;
+			do {
+				fd = open(name, flags | O_CREAT | O_EXCL, mode);
+				/* Keep retrying in the hope that it is not interrupted sometime */
+			} while (fd == -1 && errno == EINTR);
+			return fd;
+		}
+
+		inline bool name_is_taken(int err)
+		{
+			return err == EEXIST || err == EISDIR;
+		}
+
+	}
+
+}
+
+using namespace pathutils;
+
+extern "C" int pathutils_open_unique_file(const char *path, size_t ext_pos, const char *infix, int flags, int mode, char *name_buf, size_t name_bufsize)
+{
+	if (!infix)
+		infix = "";
+
+	// the name as-is comes first, whatever we remember: it may have been removed in the meantime.
+	if (!format_name(name_buf, name_bufsize, path, ext_pos, infix, 0))
+		return -1;
+	int fd = create_exclusive(name_buf, flags, mode);
+	if (fd != -1 || !name_is_taken(errno))
+		return fd;
+
+	std::string key;
+	bool have_key = name_key(path, ext_pos, infix, key);
+	unsigned int n = have_key ? reserve_suffix(key) : 0;
+
+	// `lo` is known to be taken: the name as-is, or the remembered suffix.
+	unsigned int lo = 0;
+	if (n != 0) {
+		// the remembered suffix is only worth a try while the one before it is still there.
+		if (!format_name(name_buf, name_bufsize, path, ext_pos, infix, n - 1))
+			return -1;
+		if (name_exists(name_buf)) {
+			if (!format_name(name_buf, name_bufsize, path, ext_pos, infix, n))
+				return -1;
+			fd = create_exclusive(name_buf, flags, mode);
+			if (fd != -1) {
+				remember_suffix(key, n);
+				return fd;
+			}
+			if (!name_is_taken(errno))
+				return -1;
+			lo = n;
+		} else {
+			forget_suffix(key);
+		}
+	}
+
+	// gallop from the first suffix after the one which turned out to be taken: `hi` is the first suffix found
+	// to be free (for now).
+	for (;;) {
+		unsigned int hi;
+		unsigned int step = 1;
+		for (;;) {
+			hi = (max_suffix - lo < step) ? max_suffix + 1 : lo + step;
+			if (hi > max_suffix)
+				break;
+			if (!format_name(name_buf, name_bufsize, path, ext_pos, infix, hi))
+				return -1;
+			if (!name_exists(name_buf))
+				break;
+			lo = hi;
+			step *= 2;
+		}
+		// ...and narrow it down to the lowest free suffix after `lo`.
+		while (hi - lo > 1) {
+			unsigned int mid = lo + (hi - lo) / 2;
+			if (!format_name(name_buf, name_bufsize, path, ext_pos, infix, mid))
+				return -1;
+			if (name_exists(name_buf))
+				lo = mid;
+			else
+				hi = mid;
+		}
+		if (hi > max_suffix) {
+			errno = EEXIST;
+			return -1;
+		}
+
+		if (!format_name(name_buf, name_bufsize, path, ext_pos, infix, hi))
+			return -1;
+		fd = create_exclusive(name_buf, flags, mode);
+		if (fd != -1) {
+			if (have_key)
+				remember_suffix(key, hi);
+			return fd;
+		}
+		if (!name_is_taken(errno))
+			return -1;
+		// someone beat us to it: continue the search from there.
+		lo = hi;
+	}
+}
+
+extern "C" void pathutils_unique_names_clear(void)
+{
+	std::lock_guard<std::mutex> guard(next_suffix_lock);
+	next_suffix.clear();
+}